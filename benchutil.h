@@ -0,0 +1,40 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+
+// Общие помощники программ измерения производительности
+
+// Строка в кавычках для JSON; ключи, имена и пути не содержат управляющих символов
+inline std::string JsonString(const std::string& text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+// Сбрасывает наибольший размер резидентной памяти до текущего, чтобы PeakRssKb относился
+// к одному случаю, а не ко всему процессу (запись 5 в /proc/self/clear_refs, Linux 4.0+)
+inline void ResetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+// Наибольший размер резидентной памяти процесса с последнего ResetPeakRss, КБ. Без /proc -
+// ru_maxrss, который за время работы процесса не уменьшается
+inline long PeakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
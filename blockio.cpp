@@ -0,0 +1,656 @@
+#include "blockio.h"
+#include "parallel.h"
+#include "fdstream.h"
+#include "mappedio.h"
+#include "uringio.h"
+#include "stats.h"
+#include "trace.h"
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static size_t streamChunkSize = DEFAULT_STREAM_CHUNK_SIZE;
+static IoBackend ioBackend = IoBackend::STREAM;
+static bool mappedHugePages = false;
+static unsigned uringQueueDepth = DEFAULT_URING_QUEUE_DEPTH;
+
+static const uint8_t FRAME_MAGIC[4] = {'R', 'G', 'R', 'C'};
+static const uint8_t FRAME_VERSION = 1;
+
+static void PutLE(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t GetLE(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+void EncodeFrameHeader(const FrameHeader& header, uint8_t* out) {
+    fill(out, out + FRAME_HEADER_SIZE, 0);
+    copy(FRAME_MAGIC, FRAME_MAGIC + 4, out);
+    out[4] = FRAME_VERSION;
+    out[5] = static_cast<uint8_t>(header.cipherId);
+    PutLE(out + 6, FRAME_HEADER_SIZE, 2);
+    PutLE(out + 8, header.blockSize, 4);
+    PutLE(out + 12, header.keyParam, 4);
+    PutLE(out + 16, header.originalLength, 8);
+}
+
+bool DecodeFrameHeader(const uint8_t* in, size_t size, FrameHeader& header) {
+    if (size < FRAME_HEADER_SIZE || !equal(FRAME_MAGIC, FRAME_MAGIC + 4, in)) {
+        return false;
+    }
+    if (in[4] != FRAME_VERSION || GetLE(in + 6, 2) != FRAME_HEADER_SIZE || GetLE(in + 24, 8) != 0) {
+        return false;
+    }
+    header.cipherId = static_cast<CipherId>(in[5]);
+    header.blockSize = static_cast<uint32_t>(GetLE(in + 8, 4));
+    header.keyParam = static_cast<uint32_t>(GetLE(in + 12, 4));
+    header.originalLength = GetLE(in + 16, 8);
+    return true;
+}
+
+bool FrameMatchesCipher(const FrameHeader& header, const BlockCipher& cipher) {
+    return header.cipherId == cipher.cipherId && header.blockSize == cipher.blockSize && header.keyParam == cipher.keyParam;
+}
+
+bool IsFramedFile(const string& path) {
+    ifstream input(path, ios::binary);
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    input.read(reinterpret_cast<char*>(buffer), FRAME_HEADER_SIZE);
+    FrameHeader header;
+    return DecodeFrameHeader(buffer, static_cast<size_t>(input.gcount()), header);
+}
+
+void SetStreamChunkSize(size_t bytes) {
+    streamChunkSize = bytes;
+}
+
+size_t GetStreamChunkSize() {
+    return streamChunkSize;
+}
+
+void SetIoBackend(const string& name) {
+    if (name == "whole") {
+        ioBackend = IoBackend::WHOLE;
+    } else if (name == "stream") {
+        ioBackend = IoBackend::STREAM;
+    } else if (name == "mmap" || name == "mmap-huge") {
+        ioBackend = IoBackend::MMAP;
+        mappedHugePages = (name == "mmap-huge");
+    } else if (name == "uring") {
+        ioBackend = IoBackend::URING;
+        uringQueueDepth = DEFAULT_URING_QUEUE_DEPTH;
+    } else if (name.compare(0, 6, "uring:") == 0) {
+        string depth = name.substr(6);
+        if (depth.empty() || depth.size() > 3 || depth.find_first_not_of("0123456789") != string::npos ||
+            stoul(depth) < 1 || stoul(depth) > MAX_URING_QUEUE_DEPTH) {
+            throw invalid_argument("Глубина очереди должна быть от 1 до " + to_string(MAX_URING_QUEUE_DEPTH) + ": " + name);
+        }
+        ioBackend = IoBackend::URING;
+        uringQueueDepth = static_cast<unsigned>(stoul(depth));
+    } else {
+        throw invalid_argument("Неизвестный механизм ввода-вывода: " + name);
+    }
+}
+
+IoBackend GetIoBackend() {
+    if (ioBackend == IoBackend::STREAM && streamChunkSize == 0) {
+        return IoBackend::WHOLE;
+    }
+    return ioBackend;
+}
+
+// Размер порции, выровненный по границе блока (не меньше одного блока). Потоки без
+// известного размера при нулевой настройке обрабатываются порциями размера по умолчанию
+static size_t AlignedChunkSize(size_t blockSize) {
+    size_t size = streamChunkSize != 0 ? streamChunkSize : DEFAULT_STREAM_CHUNK_SIZE;
+    size_t chunk = size - size % blockSize;
+    return max(chunk, blockSize);
+}
+
+// Порция для обычного файла не больше самого файла: буферы порций заполняются
+// при создании, и для маленьких файлов это обходилось бы дороже самой обработки
+static size_t FileChunkSize(int fd, size_t blockSize) {
+    size_t chunk = AlignedChunkSize(blockSize);
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && static_cast<uint64_t>(info.st_size) < chunk) {
+        size_t size = static_cast<size_t>(info.st_size);
+        chunk = max((size + blockSize - 1) / blockSize * blockSize, blockSize);
+    }
+    return chunk;
+}
+
+static int OpenInput(const string& inPath) {
+    int fd = open(inPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    return fd;
+}
+
+static int OpenOutput(const string& outPath) {
+    int fd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        throw runtime_error("Не удалось создать выходной файл: " + outPath);
+    }
+    return fd;
+}
+
+static string DescriptorName(int fd) {
+    return "дескриптор " + to_string(fd);
+}
+
+// Дополняет нулями последний неполный блок порции; возвращает длину для преобразования
+static size_t PadToBlock(uint8_t* buffer, size_t length, size_t blockSize) {
+    size_t tail = length % blockSize;
+    if (tail != 0) {
+        TraceSpan span("padding", blockSize - tail);
+        fill(buffer + length, buffer + length + (blockSize - tail), 0);
+        length += blockSize - tail;
+    }
+    return length;
+}
+
+// Шифрует все данные reader; возвращает количество прочитанных байт.
+// Чтение, преобразование и запись соседних порций идут одновременно
+static uint64_t EncryptStream(ChunkReader& reader, ChunkWriter& writer, const BlockCipher& cipher) {
+    uint64_t total = 0;
+    while (true) {
+        size_t read = 0;
+        uint8_t* in = reader.Next(read);
+        if (read == 0) {
+            break;
+        }
+        size_t length = PadToBlock(in, read, cipher.blockSize);
+        CountStat(Stat::PADDING_ADDED, length - read);
+        ParallelTransform(in, writer.Buffer(), length, cipher.blockSize, cipher.encrypt);
+        writer.Submit(length);
+        total += read;
+    }
+    return total;
+}
+
+static void EncryptUnframed(ChunkReader& reader, ChunkWriter& writer, const BlockCipher& cipher) {
+    uint64_t total = EncryptStream(reader, writer, cipher);
+
+    if (total == 0 && cipher.padEmpty) {
+        vector<uint8_t> in(cipher.blockSize, 0);
+        CountAllocation(cipher.blockSize);
+        CountStat(Stat::PADDING_ADDED, cipher.blockSize);
+        ParallelTransform(in.data(), writer.Buffer(), cipher.blockSize, cipher.blockSize, cipher.encrypt);
+        writer.Submit(cipher.blockSize);
+    }
+}
+
+void StreamEncryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher) {
+    FileDescriptor input(OpenInput(inPath));
+    FileDescriptor output(OpenOutput(outPath));
+
+    size_t chunk = FileChunkSize(input.Get(), cipher.blockSize);
+    ChunkWriter writer(output.Get(), chunk, outPath);
+    ChunkReader reader(input.Get(), chunk, inPath);
+    EncryptUnframed(reader, writer, cipher);
+    writer.Finish();
+}
+
+void StreamEncryptFileFramed(const string& inPath, const string& outPath, const BlockCipher& cipher) {
+    FileDescriptor input(OpenInput(inPath));
+    FileDescriptor output(OpenOutput(outPath));
+
+    FrameHeader header;
+    header.cipherId = cipher.cipherId;
+    header.blockSize = static_cast<uint32_t>(cipher.blockSize);
+    header.keyParam = cipher.keyParam;
+    header.originalLength = 0;
+
+    // Длина известна только после чтения: заголовок переписывается в конце,
+    // поэтому файл, дописываемый во время шифрования, тоже обрабатывается верно
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    EncodeFrameHeader(header, buffer);
+    WriteFull(output.Get(), buffer, FRAME_HEADER_SIZE, outPath);
+
+    size_t chunk = FileChunkSize(input.Get(), cipher.blockSize);
+    {
+        ChunkWriter writer(output.Get(), chunk, outPath);
+        ChunkReader reader(input.Get(), chunk, inPath);
+        header.originalLength = EncryptStream(reader, writer, cipher);
+        writer.Finish();
+    }
+
+    EncodeFrameHeader(header, buffer);
+    if (pwrite(output.Get(), buffer, FRAME_HEADER_SIZE, 0) != static_cast<ssize_t>(FRAME_HEADER_SIZE)) {
+        throw runtime_error("Ошибка записи в выходной файл: " + outPath);
+    }
+}
+
+static void DecryptFramed(ChunkReader& reader, ChunkWriter& writer, const BlockCipher& cipher, const FrameHeader& header) {
+    if (!FrameMatchesCipher(header, cipher)) {
+        throw runtime_error("Файл зашифрован другим шифром или с другим ключом");
+    }
+
+    uint64_t remaining = header.originalLength;
+    while (remaining > 0) {
+        size_t length = 0;
+        uint8_t* in = reader.Next(length);
+        if (length == 0) {
+            break;
+        }
+        if (length % cipher.blockSize != 0) {
+            throw runtime_error("Зашифрованный файл повреждён: неполный последний блок");
+        }
+        ParallelTransform(in, writer.Buffer(), length, cipher.blockSize, cipher.decrypt);
+
+        size_t count = static_cast<size_t>(min<uint64_t>(remaining, length));
+        CountStat(Stat::PADDING_STRIPPED, length - count);
+        writer.Submit(count);
+        remaining -= count;
+    }
+
+    if (remaining > 0) {
+        throw runtime_error("Зашифрованный файл повреждён: данные короче длины из заголовка");
+    }
+}
+
+static void WriteZeros(ChunkWriter& writer, uint64_t count, size_t chunk) {
+    while (count > 0) {
+        size_t part = static_cast<size_t>(min<uint64_t>(count, chunk));
+        fill(writer.Buffer(), writer.Buffer() + part, 0);
+        writer.Submit(part);
+        count -= part;
+    }
+}
+
+static void DecryptUnframed(ChunkReader& reader, ChunkWriter& writer, const BlockCipher& cipher, size_t chunk) {
+    // Нули в конце порции придерживаются, пока не встретится ненулевой байт:
+    // так результат совпадает с отбрасыванием нулей в конце всего файла
+    uint64_t pendingZeros = 0;
+
+    while (true) {
+        size_t read = 0;
+        uint8_t* in = reader.Next(read);
+        if (read == 0) {
+            break;
+        }
+        size_t length = PadToBlock(in, read, cipher.blockSize);
+        uint8_t* out = writer.Buffer();
+        ParallelTransform(in, out, length, cipher.blockSize, cipher.decrypt);
+
+        size_t dataEnd = length;
+        {
+            TraceSpan span("padding");
+            while (dataEnd > 0 && out[dataEnd - 1] == 0) {
+                --dataEnd;
+            }
+            span.SetBytes(length - dataEnd);
+        }
+        if (dataEnd == 0) {
+            pendingZeros += length;
+            continue;
+        }
+
+        if (pendingZeros > 0) {
+            // Редкий случай: перед данными нужно записать придержанные нули,
+            // а буфер записи уже занят расшифрованной порцией
+            vector<uint8_t> data(out, out + dataEnd);
+            CountAllocation(dataEnd);
+            WriteZeros(writer, pendingZeros, chunk);
+            copy(data.begin(), data.end(), writer.Buffer());
+        }
+        writer.Submit(dataEnd);
+        pendingZeros = length - dataEnd;
+    }
+    CountStat(Stat::PADDING_STRIPPED, pendingZeros);
+}
+
+// Расшифрование с распознаванием заголовка без перемещения по входу: прочитанные
+// для проверки байты файла без заголовка передаются обратно в начало данных
+static void DecryptDescriptors(int inFd, int outFd, const string& inName, const string& outName, const BlockCipher& cipher) {
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    size_t headerRead = ReadFull(inFd, buffer, FRAME_HEADER_SIZE, inName);
+    FrameHeader header;
+    bool framed = DecodeFrameHeader(buffer, headerRead, header);
+
+    size_t chunk = FileChunkSize(inFd, cipher.blockSize);
+    ChunkWriter writer(outFd, chunk, outName);
+    if (framed) {
+        ChunkReader reader(inFd, chunk, inName);
+        DecryptFramed(reader, writer, cipher, header);
+    } else {
+        ChunkReader reader(inFd, chunk, inName, buffer, headerRead);
+        DecryptUnframed(reader, writer, cipher, chunk);
+    }
+    writer.Finish();
+}
+
+void StreamDecryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher) {
+    FileDescriptor input(OpenInput(inPath));
+    FileDescriptor output(OpenOutput(outPath));
+    DecryptDescriptors(input.Get(), output.Get(), inPath, outPath, cipher);
+}
+
+void StreamEncryptDescriptor(int inFd, int outFd, const BlockCipher& cipher) {
+    size_t chunk = AlignedChunkSize(cipher.blockSize);
+    ChunkWriter writer(outFd, chunk, DescriptorName(outFd));
+    ChunkReader reader(inFd, chunk, DescriptorName(inFd));
+    EncryptUnframed(reader, writer, cipher);
+    writer.Finish();
+}
+
+void StreamDecryptDescriptor(int inFd, int outFd, const BlockCipher& cipher) {
+    DecryptDescriptors(inFd, outFd, DescriptorName(inFd), DescriptorName(outFd), cipher);
+}
+
+// Читает файл целиком. Размер из fstat - только начальная оценка: файл мог вырасти,
+// а у каналов и файлов /proc размера нет, поэтому чтение идёт до конца данных
+static vector<uint8_t> ReadWholeFile(const string& path) {
+    FileDescriptor input(OpenInput(path));
+    struct stat info;
+    size_t expected = 0;
+    if (fstat(input.Get(), &info) == 0 && S_ISREG(info.st_mode)) {
+        expected = static_cast<size_t>(info.st_size);
+    }
+
+    vector<uint8_t> content(expected > 0 ? expected + 1 : 64 << 10);
+    CountAllocation(content.size());
+    size_t length = 0;
+    while (true) {
+        length += ReadFull(input.Get(), content.data() + length, content.size() - length, path);
+        if (length < content.size()) {
+            break;
+        }
+        content.resize(content.size() * 2);
+        CountAllocation(content.size());
+    }
+    content.resize(length);
+    return content;
+}
+
+static void WriteWholeFile(const string& path, const uint8_t* data, size_t size) {
+    FileDescriptor output(OpenOutput(path));
+    WriteFull(output.Get(), data, size, path);
+}
+
+// Преобразование данных в памяти; последний неполный блок дополняется нулями
+static vector<uint8_t> TransformPadded(const vector<uint8_t>& data, const BlockCipher& cipher, bool encrypt) {
+    size_t blockSize = cipher.blockSize;
+    const BlockTransform& transform = encrypt ? cipher.encrypt : cipher.decrypt;
+    size_t fullLength = data.size() - data.size() % blockSize;
+    size_t paddedLength = fullLength;
+    if (fullLength < data.size() || (data.empty() && encrypt && cipher.padEmpty)) {
+        paddedLength += blockSize;
+    }
+
+    vector<uint8_t> result(paddedLength);
+    CountAllocation(paddedLength);
+    ParallelTransform(data.data(), result.data(), fullLength, blockSize, transform);
+
+    if (paddedLength > fullLength) {
+        vector<uint8_t> lastBlock(blockSize, 0);
+        CountAllocation(blockSize);
+        copy(data.begin() + fullLength, data.end(), lastBlock.begin());
+        ParallelTransform(lastBlock.data(), result.data() + fullLength, blockSize, blockSize, transform);
+        if (encrypt) {
+            CountStat(Stat::PADDING_ADDED, paddedLength - data.size());
+        }
+    }
+    return result;
+}
+
+void EncryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher) {
+    switch (GetIoBackend()) {
+        case IoBackend::STREAM:
+            StreamEncryptFile(inPath, outPath, cipher);
+            return;
+        case IoBackend::MMAP:
+            MappedEncryptFile(inPath, outPath, cipher, mappedHugePages);
+            return;
+        case IoBackend::URING:
+            UringEncryptFile(inPath, outPath, cipher, uringQueueDepth);
+            return;
+        case IoBackend::WHOLE:
+            break;
+    }
+
+    vector<uint8_t> encrypted = TransformPadded(ReadWholeFile(inPath), cipher, true);
+    WriteWholeFile(outPath, encrypted.data(), encrypted.size());
+}
+
+void DecryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher) {
+    switch (GetIoBackend()) {
+        case IoBackend::STREAM:
+            StreamDecryptFile(inPath, outPath, cipher);
+            return;
+        case IoBackend::MMAP:
+            MappedDecryptFile(inPath, outPath, cipher, mappedHugePages);
+            return;
+        case IoBackend::URING:
+            UringDecryptFile(inPath, outPath, cipher, uringQueueDepth);
+            return;
+        case IoBackend::WHOLE:
+            break;
+    }
+
+    if (IsFramedFile(inPath)) {
+        StreamDecryptFile(inPath, outPath, cipher);
+        return;
+    }
+
+    vector<uint8_t> decrypted = TransformPadded(ReadWholeFile(inPath), cipher, false);
+    size_t length = decrypted.size();
+    {
+        TraceSpan span("padding");
+        while (length > 0 && decrypted[length - 1] == 0) {
+            --length;
+        }
+        span.SetBytes(decrypted.size() - length);
+    }
+    CountStat(Stat::PADDING_STRIPPED, decrypted.size() - length);
+    WriteWholeFile(outPath, decrypted.data(), length);
+}
+
+// Читает ровно size байт с позиции offset (меньше - только в конце файла)
+static size_t ReadAt(int fd, uint8_t* buffer, size_t size, uint64_t offset) {
+    StatTimer timer(Stat::READ_NS, size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(fd, buffer + done, size - done, static_cast<off_t>(offset + done));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("Ошибка чтения файла: ") + strerror(errno));
+        }
+        if (got == 0) {
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    CountStat(Stat::BYTES_IN, done);
+    return done;
+}
+
+// Расшифровывает блоки [firstBlock, firstBlock + count) в out; неполный последний блок дополняется нулями
+static void DecryptBlocksAt(int fd, uint64_t dataStart, uint64_t dataSize, const BlockCipher& cipher,
+                            uint64_t firstBlock, size_t count, vector<uint8_t>& in, uint8_t* out) {
+    size_t length = count * cipher.blockSize;
+    uint64_t position = firstBlock * cipher.blockSize;
+    size_t available = static_cast<size_t>(min<uint64_t>(length, dataSize - position));
+    size_t read = ReadAt(fd, in.data(), available, dataStart + position);
+    fill(in.begin() + read, in.begin() + length, 0);
+    ParallelTransform(in.data(), out, length, cipher.blockSize, cipher.decrypt);
+}
+
+// Длина данных файла без заголовка: расшифровываются блоки с конца до первого ненулевого байта.
+// Обычно дополнение укладывается в последний блок, поэтому окно начинается с одного блока
+// и удваивается до порции: длинная серия нулей в конце читается порциями, а не по блоку
+uint64_t UnframedPlainLength(int fd, uint64_t dataSize, const BlockCipher& cipher) {
+    TraceSpan span("padding");
+    size_t blockSize = cipher.blockSize;
+    uint64_t blocks = (dataSize + blockSize - 1) / blockSize;
+    size_t maxCount = static_cast<size_t>(min<uint64_t>(AlignedChunkSize(blockSize) / blockSize, max<uint64_t>(blocks, 1)));
+    vector<uint8_t> in(maxCount * blockSize), out(maxCount * blockSize);
+    CountAllocation(in.size());
+    CountAllocation(out.size());
+
+    size_t count = 1;
+    while (blocks > 0) {
+        count = static_cast<size_t>(min<uint64_t>(count, blocks));
+        blocks -= count;
+        DecryptBlocksAt(fd, 0, dataSize, cipher, blocks, count, in, out.data());
+        for (size_t i = count * blockSize; i > 0; --i) {
+            if (out[i - 1] != 0) {
+                return blocks * blockSize + i;
+            }
+        }
+        count = min(count * 2, maxCount);
+    }
+    return 0;
+}
+
+size_t DecryptFileRange(const string& inPath, const BlockCipher& cipher, uint64_t offset, uint64_t length, uint8_t* out) {
+    FileDescriptor file(open(inPath.c_str(), O_RDONLY));
+    if (file.Get() < 0) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    struct stat info;
+    if (fstat(file.Get(), &info) != 0) {
+        throw runtime_error("Не удалось получить размер файла: " + inPath);
+    }
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+
+    size_t chunk = AlignedChunkSize(cipher.blockSize);
+    vector<uint8_t> in(chunk), decrypted(chunk);
+    CountAllocation(chunk);
+    CountAllocation(chunk);
+
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    size_t headerRead = ReadAt(file.Get(), buffer, FRAME_HEADER_SIZE, 0);
+    FrameHeader header;
+    uint64_t dataStart = 0;
+    uint64_t plainLength = 0;
+    if (DecodeFrameHeader(buffer, headerRead, header)) {
+        if (!FrameMatchesCipher(header, cipher)) {
+            throw runtime_error("Файл зашифрован другим шифром или с другим ключом");
+        }
+        dataStart = FRAME_HEADER_SIZE;
+        plainLength = header.originalLength;
+        if (fileSize - dataStart < plainLength) {
+            throw runtime_error("Зашифрованный файл повреждён: данные короче длины из заголовка");
+        }
+    } else {
+        plainLength = UnframedPlainLength(file.Get(), fileSize, cipher);
+    }
+    uint64_t dataSize = fileSize - dataStart;
+
+    if (offset >= plainLength || length == 0) {
+        return 0;
+    }
+    uint64_t end = offset + min(length, plainLength - offset);
+
+    size_t blockSize = cipher.blockSize;
+    size_t blocksPerChunk = chunk / blockSize;
+    uint64_t block = offset / blockSize;
+    uint64_t lastBlock = (end - 1) / blockSize;
+    uint64_t position = offset;
+
+    while (block <= lastBlock) {
+        size_t count = static_cast<size_t>(min<uint64_t>(blocksPerChunk, lastBlock - block + 1));
+        DecryptBlocksAt(file.Get(), dataStart, dataSize, cipher, block, count, in, decrypted.data());
+
+        uint64_t chunkStart = block * blockSize;
+        uint64_t chunkEnd = min<uint64_t>(chunkStart + count * blockSize, end);
+        copy(decrypted.begin() + (position - chunkStart), decrypted.begin() + (chunkEnd - chunkStart), out + (position - offset));
+        position = chunkEnd;
+        block += count;
+    }
+
+    CountStat(Stat::BYTES_OUT, end - offset);
+    return static_cast<size_t>(end - offset);
+}
+
+// Копия на стеке, через которую блоки переставляются на месте
+static const size_t IN_PLACE_SCRATCH_SIZE = 64 << 10;
+
+// Каждая часть ParallelTransform копирует свои блоки в копию потока и переставляет их
+// обратно в buffer; части не пересекаются, поэтому потоки друг другу не мешают
+static void TransformInPlace(uint8_t* buffer, size_t length, size_t blockSize, const BlockTransform& transform) {
+    ParallelTransform(buffer, buffer, length, blockSize, [&](const uint8_t*, uint8_t* part, size_t partLength) {
+        if (blockSize <= IN_PLACE_SCRATCH_SIZE) {
+            alignas(64) uint8_t scratch[IN_PLACE_SCRATCH_SIZE];
+            size_t step = IN_PLACE_SCRATCH_SIZE / blockSize * blockSize;
+            for (size_t offset = 0; offset < partLength; offset += step) {
+                size_t size = min(step, partLength - offset);
+                memcpy(scratch, part + offset, size);
+                transform(scratch, part + offset, size);
+            }
+            return;
+        }
+
+        thread_local vector<uint8_t> scratch;
+        if (scratch.size() < blockSize) {
+            scratch.resize(blockSize);
+            CountAllocation(blockSize);
+        }
+        for (size_t offset = 0; offset < partLength; offset += blockSize) {
+            memcpy(scratch.data(), part + offset, blockSize);
+            transform(scratch.data(), part + offset, blockSize);
+        }
+    });
+}
+
+size_t EncryptedBufferSize(size_t length, const BlockCipher& cipher) {
+    if (length == 0) {
+        return cipher.padEmpty ? cipher.blockSize : 0;
+    }
+    return (length + cipher.blockSize - 1) / cipher.blockSize * cipher.blockSize;
+}
+
+size_t EncryptBuffer(uint8_t* buffer, size_t length, size_t capacity, const BlockCipher& cipher) {
+    size_t size = EncryptedBufferSize(length, cipher);
+    if (capacity < size) {
+        throw length_error("Недостаточный размер буфера: нужно " + to_string(size) + " байт");
+    }
+    if (size != length) {
+        TraceSpan span("padding", size - length);
+        fill(buffer + length, buffer + size, 0);
+    }
+    CountStat(Stat::BYTES_IN, length);
+    CountStat(Stat::PADDING_ADDED, size - length);
+    TransformInPlace(buffer, size, cipher.blockSize, cipher.encrypt);
+    CountStat(Stat::BYTES_OUT, size);
+    return size;
+}
+
+size_t DecryptBuffer(uint8_t* buffer, size_t length, const BlockCipher& cipher) {
+    if (length % cipher.blockSize != 0) {
+        throw invalid_argument("Длина зашифрованных данных не кратна размеру блока " + to_string(cipher.blockSize));
+    }
+    CountStat(Stat::BYTES_IN, length);
+    TransformInPlace(buffer, length, cipher.blockSize, cipher.decrypt);
+    size_t dataEnd = length;
+    {
+        TraceSpan span("padding");
+        while (dataEnd > 0 && buffer[dataEnd - 1] == 0) {
+            --dataEnd;
+        }
+        span.SetBytes(length - dataEnd);
+    }
+    CountStat(Stat::PADDING_STRIPPED, length - dataEnd);
+    CountStat(Stat::BYTES_OUT, dataEnd);
+    return dataEnd;
+}
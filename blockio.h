@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Преобразование целых блоков: length кратно размеру блока, src и dst не пересекаются
+using BlockTransform = std::function<void(const uint8_t* src, uint8_t* dst, size_t length)>;
+
+enum class CipherId : uint8_t {
+    PERMUTATION = 1,
+    MATRIX,
+    MAGIC_SQUARE,
+    CASCADE
+};
+
+// Блочный шифр с точки зрения файлового ввода-вывода
+struct BlockCipher {
+    size_t blockSize;
+    BlockTransform encrypt;
+    BlockTransform decrypt;
+    bool padEmpty; // пустой файл шифруется в один нулевой блок
+    CipherId cipherId;
+    uint32_t keyParam; // параметр ключа, не раскрывающий его: длина перестановки, размер квадрата или свёртка таблицы каскада
+};
+
+// Заголовок контейнера: "RGRC", версия, шифр, размер заголовка, размер блока,
+// параметр ключа, исходная длина, резерв; все числа little-endian
+const size_t FRAME_HEADER_SIZE = 32;
+
+struct FrameHeader {
+    CipherId cipherId;
+    uint32_t blockSize;
+    uint32_t keyParam;
+    uint64_t originalLength;
+};
+
+void EncodeFrameHeader(const FrameHeader& header, uint8_t* out);
+bool DecodeFrameHeader(const uint8_t* in, size_t size, FrameHeader& header);
+
+// Заголовок записан этим шифром с этим ключом (по параметру ключа)
+bool FrameMatchesCipher(const FrameHeader& header, const BlockCipher& cipher);
+
+// Проверка, что файл начинается с заголовка контейнера
+bool IsFramedFile(const std::string& path);
+
+// Размер порции потоковой обработки в байтах; 0 - читать файл целиком
+const size_t DEFAULT_STREAM_CHUNK_SIZE = 4 << 20;
+void SetStreamChunkSize(size_t bytes);
+size_t GetStreamChunkSize();
+
+// Механизм файлового ввода-вывода
+enum class IoBackend {
+    WHOLE,  // файл читается в память целиком
+    STREAM, // порциями, чтение и запись идут одновременно с преобразованием
+    MMAP,   // через отображение входного и выходного файлов в память
+    URING   // асинхронно через io_uring с очередью из нескольких порций
+};
+
+const unsigned DEFAULT_URING_QUEUE_DEPTH = 8;
+const unsigned MAX_URING_QUEUE_DEPTH = 256;
+
+// Выбор механизма по имени: "whole", "stream" (по умолчанию), "mmap" или "mmap-huge" -
+// отображение с большими страницами, "uring" или "uring:N" с глубиной очереди N
+// от 1 до MAX_URING_QUEUE_DEPTH. Неизвестное имя - invalid_argument
+void SetIoBackend(const std::string& name);
+
+// Действующий механизм: потоковый режим с нулевым размером порции означает обработку целиком
+IoBackend GetIoBackend();
+
+// Шифрование и расшифрование файла выбранным механизмом. Результат от механизма не зависит;
+// контейнер с заголовком распознаётся при расшифровании всегда
+void EncryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher);
+void DecryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher);
+
+// Потоковое шифрование: последний неполный блок дополняется нулями
+void StreamEncryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher);
+
+// Шифрование в контейнер с заголовком: расшифрование восстанавливает точную длину
+void StreamEncryptFileFramed(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher);
+
+// Потоковое расшифрование. Контейнер обрезается по сохранённой длине, у файла без
+// заголовка нули в конце результата отбрасываются, как и при обработке целиком
+void StreamDecryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher);
+
+// Потоковая обработка открытых дескрипторов, например каналов или стандартных потоков:
+// вход читается последовательно до конца, дескрипторы не закрываются. Расшифрование
+// распознаёт заголовок контейнера, как и StreamDecryptFile
+void StreamEncryptDescriptor(int inFd, int outFd, const BlockCipher& cipher);
+void StreamDecryptDescriptor(int inFd, int outFd, const BlockCipher& cipher);
+
+// Длина исходных данных файла без заголовка размера dataSize: блоки расшифровываются
+// с конца до первого ненулевого байта, нулевое дополнение не входит в длину
+uint64_t UnframedPlainLength(int fd, uint64_t dataSize, const BlockCipher& cipher);
+
+// Расшифрование диапазона [offset, offset + length) исходных данных без чтения всего файла:
+// читаются только покрывающие его блоки. Возвращает количество записанных в out байт
+// (меньше length, если диапазон выходит за конец данных)
+size_t DecryptFileRange(const std::string& inPath, const BlockCipher& cipher, uint64_t offset, uint64_t length, uint8_t* out);
+
+// Размер буфера для шифрования length байт на месте: длина, округлённая вверх до блока
+// (пустые данные шифра с padEmpty - один блок)
+size_t EncryptedBufferSize(size_t length, const BlockCipher& cipher);
+
+// Шифрование данных в памяти на месте без выделения памяти: buffer[0, length) дополняется
+// нулями до целого блока, и каждый блок переставляется внутри buffer через копию на стеке
+// (копия большего блока - буфер потока, растущий один раз). В buffer должно быть
+// capacity >= EncryptedBufferSize байт, иначе length_error. Возвращает длину результата
+size_t EncryptBuffer(uint8_t* buffer, size_t length, size_t capacity, const BlockCipher& cipher);
+
+// Расшифрование на месте: length кратна размеру блока, иначе invalid_argument. Возвращает
+// длину данных без нулей в конце, как при расшифровании файла без заголовка
+size_t DecryptBuffer(uint8_t* buffer, size_t length, const BlockCipher& cipher);
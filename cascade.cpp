@@ -0,0 +1,394 @@
+#include "cascade.h"
+#include "blockio.h"
+#include "parallel.h"
+#include "registry.h"
+#include "uringio.h"
+#include "stats.h"
+#include "tablecache.h"
+#include "trace.h"
+#include "vectorgather.h"
+#include <string>
+#include <vector>
+#include <sstream>
+#include <numeric>
+#include <stdexcept>
+#include <cstdint>
+#include <memory>
+#include <dlfcn.h>
+
+using namespace std;
+
+const char* const CASCADE_NAME = "cascade";
+const char* const CASCADE_KEY_FORMAT = "Неверный формат ключа каскада. Используйте формат: permutation:3-1-4-2,matrix:5";
+
+// Каталог, из которого загружена эта библиотека
+static string LibraryDirectory() {
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(&CascadeMakeKey), &info) == 0 || !info.dli_fname) {
+        return DEFAULT_LIB_DIRECTORY;
+    }
+    string path = info.dli_fname;
+    size_t slash = path.rfind('/');
+    return slash == string::npos ? "." : path.substr(0, slash);
+}
+
+// Библиотеки шагов загружаются при первом разборе ключа и не выгружаются:
+// их функции нужны, пока загружена сама библиотека каскада
+static const CipherRegistry& StageRegistry() {
+    static const CipherRegistry* registry = [] {
+        auto loaded = new CipherRegistry;
+        vector<string> errors;
+        loaded->LoadDirectory(LibraryDirectory(), errors);
+        return loaded;
+    }();
+    return *registry;
+}
+
+struct ResolvedStage {
+    const CipherPlugin* cipher;
+    string key;
+};
+
+vector<ResolvedStage> ParseCascadeKey(const string& key) {
+    vector<ResolvedStage> stages;
+    stringstream ss(key);
+    string token;
+
+    while (getline(ss, token, ',')) {
+        size_t colon = token.find(':');
+        if (colon == string::npos || colon == 0 || colon + 1 == token.size()) {
+            throw invalid_argument(CASCADE_KEY_FORMAT);
+        }
+        string name = token.substr(0, colon);
+        if (name == CASCADE_NAME) {
+            throw invalid_argument("Каскад не может включать другой каскад");
+        }
+        const CipherPlugin* cipher = StageRegistry().Find(name);
+        if (!cipher) {
+            throw invalid_argument("Шифр шага каскада не найден: " + name);
+        }
+        stages.push_back({cipher, token.substr(colon + 1)});
+    }
+
+    if (stages.empty() || key.back() == ',') {
+        throw invalid_argument(CASCADE_KEY_FORMAT);
+    }
+    return stages;
+}
+
+string CascadeMakeKey(const vector<CascadeStage>& stages) {
+    string key;
+    for (const auto& stage : stages) {
+        if (stage.cipher.empty() || stage.key.empty() || stage.cipher.find_first_of(",:") != string::npos ||
+            stage.key.find(',') != string::npos) {
+            throw invalid_argument("Недопустимый шаг каскада: " + stage.cipher + ":" + stage.key);
+        }
+        if (!key.empty()) key += ",";
+        key += stage.cipher + ":" + stage.key;
+    }
+    return key;
+}
+
+string GenerateCascadeKey() {
+    vector<CascadeStage> stages;
+    for (const LoadedCipher& loaded : StageRegistry().Ciphers()) {
+        if (string(loaded.plugin->name) != CASCADE_NAME) {
+            stages.push_back({loaded.plugin->name, loaded.plugin->generateKey()});
+        }
+    }
+    if (stages.empty()) {
+        throw runtime_error("Не найдено шифров для каскада в каталоге " + LibraryDirectory());
+    }
+    return CascadeMakeKey(stages);
+}
+
+// Таблицы блока каскада; байтовые - для векторного ядра, если блок не больше MAX_VECTOR_GATHER_BLOCK
+struct CascadeTables {
+    vector<uint32_t> encrypt;
+    vector<uint32_t> decrypt;
+    vector<uint8_t> encryptBytes;
+    vector<uint8_t> decryptBytes;
+    uint32_t fingerprint; // параметр ключа в заголовке контейнера
+
+    size_t TableBytes() const {
+        return (encrypt.size() + decrypt.size()) * sizeof(uint32_t) + encryptBytes.size() + decryptBytes.size();
+    }
+};
+
+// Шаг переставляет байты внутри своих блоков размера b, поэтому на блоке каскада его таблица g
+// продолжается как G[p] = p - p % b + g[p % b]. Выход каскада z[p] = x[G1[G2[...GN[p]]]]
+vector<uint32_t> ComposeTables(const vector<vector<uint32_t>>& tables) {
+    size_t blockSize = 1;
+    for (const auto& table : tables) {
+        if (table.empty()) {
+            throw runtime_error("Таблица шага каскада пуста");
+        }
+        vector<bool> seen(table.size(), false);
+        for (uint32_t index : table) {
+            if (index >= table.size() || seen[index]) {
+                throw runtime_error("Таблица шага каскада не является перестановкой");
+            }
+            seen[index] = true;
+        }
+        size_t divisor = gcd(blockSize, table.size());
+        if (table.size() / divisor > MAX_CASCADE_BLOCK_SIZE / blockSize) {
+            throw invalid_argument("Блок каскада (НОК размеров блоков шагов) превышает " +
+                                   to_string(MAX_CASCADE_BLOCK_SIZE >> 20) + " МБ");
+        }
+        blockSize = blockSize / divisor * table.size();
+    }
+
+    vector<uint32_t> composed(blockSize);
+    for (size_t p = 0; p < blockSize; ++p) {
+        size_t index = p;
+        for (size_t i = tables.size(); i > 0; --i) {
+            const vector<uint32_t>& table = tables[i - 1];
+            size_t offset = index % table.size();
+            index = index - offset + table[offset];
+        }
+        composed[p] = static_cast<uint32_t>(index);
+    }
+    return composed;
+}
+
+// FNV-1a от составной таблицы: различает каскады с одинаковыми размером блока и числом шагов,
+// а равные по действию записи ключа (например, с другой записью шага) дают одно значение
+uint32_t TableFingerprint(const vector<uint32_t>& table) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t index : table) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash ^= (index >> shift) & 0xFF;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+CascadeTables BuildCascadeTables(const vector<ResolvedStage>& stages) {
+    vector<vector<uint32_t>> stageTables;
+    for (const auto& stage : stages) {
+        stageTables.push_back(stage.cipher->encryptTable(stage.key));
+    }
+
+    TraceSpan span("table_build");
+    CascadeTables tables;
+    tables.encrypt = ComposeTables(stageTables);
+    size_t blockSize = tables.encrypt.size();
+    span.SetBytes(blockSize);
+    tables.fingerprint = TableFingerprint(tables.encrypt);
+    tables.decrypt.resize(blockSize);
+    for (size_t p = 0; p < blockSize; ++p) {
+        tables.decrypt[tables.encrypt[p]] = static_cast<uint32_t>(p);
+    }
+    if (blockSize <= MAX_VECTOR_GATHER_BLOCK) {
+        tables.encryptBytes.assign(tables.encrypt.begin(), tables.encrypt.end());
+        tables.decryptBytes.assign(tables.decrypt.begin(), tables.decrypt.end());
+    }
+    return tables;
+}
+
+// Составленные таблицы по строке шагов: в пакетном режиме каждый файл шифруется по ключу
+// заново, а опрос таблиц шагов и составление занимают больше, чем сама перестановка файла
+shared_ptr<const CascadeTables> GetCascadeTables(const vector<ResolvedStage>& stages) {
+    string key;
+    for (const auto& stage : stages) {
+        if (!key.empty()) key += ",";
+        key += string(stage.cipher->name) + ":" + stage.key;
+    }
+    static TableCache<CascadeTables, string> cache;
+    return cache.Get(key, [&stages] {
+        return make_shared<const CascadeTables>(BuildCascadeTables(stages));
+    });
+}
+
+// dst[block + k] = src[block + table[k]] для целых блоков каскада
+void GatherCascadeBlocks(const uint8_t* src, uint8_t* dst, size_t length, const vector<uint32_t>& table, const vector<uint8_t>& bytes) {
+    size_t blockSize = table.size();
+    size_t block = 0;
+    if (!bytes.empty()) {
+        block = GatherBlocksVector(src, dst, length, bytes.data(), blockSize);
+    }
+    for (; block < length; block += blockSize) {
+        const uint8_t* in = src + block;
+        uint8_t* out = dst + block;
+        for (size_t k = 0; k < blockSize; ++k) {
+            out[k] = in[table[k]];
+        }
+    }
+}
+
+BlockCipher MakeCascadeCipher(const vector<ResolvedStage>& stages) {
+    shared_ptr<const CascadeTables> tables = GetCascadeTables(stages);
+
+    BlockCipher cipher;
+    cipher.blockSize = tables->encrypt.size();
+    cipher.encrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherCascadeBlocks(src, dst, length, tables->encrypt, tables->encryptBytes);
+    };
+    cipher.decrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherCascadeBlocks(src, dst, length, tables->decrypt, tables->decryptBytes);
+    };
+    cipher.padEmpty = false;
+    cipher.cipherId = CipherId::CASCADE;
+    cipher.keyParam = tables->fingerprint;
+    return cipher;
+}
+
+void CascadeSetChunkSize(size_t bytes) {
+    SetStreamChunkSize(bytes);
+}
+
+void CascadeSetIoBackend(const string& name) {
+    SetIoBackend(name);
+}
+
+void CascadeSetThreadCount(unsigned count) {
+    SetThreadCount(count);
+}
+
+AsyncIoStats CascadeGetAsyncIoStats() {
+    return GetAsyncIoStats();
+}
+
+CipherStats CascadeGetStats() {
+    return GetCipherStats();
+}
+
+void CascadeResetStats() {
+    ResetCipherStats();
+}
+
+void CascadeSetStatsEnabled(bool enabled) {
+    SetStatsEnabled(enabled);
+}
+
+// Шаги и составной шифр для них
+struct CascadeContext {
+    vector<ResolvedStage> stages;
+    BlockCipher cipher;
+};
+
+CascadeContext* CascadeCreateContext(const string& key) {
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    auto context = make_unique<CascadeContext>();
+    context->stages = ParseCascadeKey(key);
+    context->cipher = MakeCascadeCipher(context->stages);
+    return context.release();
+}
+
+void CascadeDestroyContext(CascadeContext* context) {
+    delete context;
+}
+
+size_t CascadeBlockSize(const CascadeContext* context) {
+    return context->cipher.blockSize;
+}
+
+string CascadeEncryptWithContext(const CascadeContext* context, const string& text) {
+    CountStat(Stat::CALLS);
+    string result = text;
+    for (const auto& stage : context->stages) {
+        result = stage.cipher->textEncrypt(result, stage.key);
+    }
+    return result;
+}
+
+string CascadeDecryptWithContext(const CascadeContext* context, const string& encryptedText) {
+    CountStat(Stat::CALLS);
+    string result = encryptedText;
+    for (auto stage = context->stages.rbegin(); stage != context->stages.rend(); ++stage) {
+        result = stage->cipher->textDecrypt(result, stage->key);
+    }
+    return result;
+}
+
+void CascadeFileEncryptWithContext(const CascadeContext* context, const string& inPath, const string& outPath) {
+    CountStat(Stat::CALLS);
+    EncryptFile(inPath, outPath, context->cipher);
+}
+
+void CascadeFileDecryptWithContext(const CascadeContext* context, const string& inPath, const string& outPath) {
+    CountStat(Stat::CALLS);
+    DecryptFile(inPath, outPath, context->cipher);
+}
+
+string CascadeTextEncrypt(const string& text, const string& key) {
+    CountStat(Stat::CALLS);
+    string result = text;
+    for (const auto& stage : ParseCascadeKey(key)) {
+        result = stage.cipher->textEncrypt(result, stage.key);
+    }
+    return result;
+}
+
+string CascadeTextDecrypt(const string& encryptedText, const string& key) {
+    CountStat(Stat::CALLS);
+    vector<ResolvedStage> stages = ParseCascadeKey(key);
+    string result = encryptedText;
+    for (auto stage = stages.rbegin(); stage != stages.rend(); ++stage) {
+        result = stage->cipher->textDecrypt(result, stage->key);
+    }
+    return result;
+}
+
+// Шифр для ключа файловой операции: учитывается вызов и время разбора ключа и составления таблиц
+BlockCipher CascadeCipherForKey(const string& key) {
+    CountStat(Stat::CALLS);
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    return MakeCascadeCipher(ParseCascadeKey(key));
+}
+
+void CascadeFileEncrypt(const string& inPath, const string& outPath, const string& key) {
+    EncryptFile(inPath, outPath, CascadeCipherForKey(key));
+}
+
+void CascadeFileEncryptFramed(const string& inPath, const string& outPath, const string& key) {
+    StreamEncryptFileFramed(inPath, outPath, CascadeCipherForKey(key));
+}
+
+void CascadeFileDecrypt(const string& inPath, const string& outPath, const string& key) {
+    DecryptFile(inPath, outPath, CascadeCipherForKey(key));
+}
+
+void CascadeStreamEncrypt(int inFd, int outFd, const string& key) {
+    StreamEncryptDescriptor(inFd, outFd, CascadeCipherForKey(key));
+}
+
+void CascadeStreamDecrypt(int inFd, int outFd, const string& key) {
+    StreamDecryptDescriptor(inFd, outFd, CascadeCipherForKey(key));
+}
+
+size_t CascadeDecryptRange(const string& inPath, const string& key, uint64_t offset, uint64_t length, uint8_t* out) {
+    return DecryptFileRange(inPath, CascadeCipherForKey(key), offset, length, out);
+}
+
+size_t CascadeEncryptInPlace(const CascadeContext* context, uint8_t* buffer, size_t length, size_t capacity) {
+    CountStat(Stat::CALLS);
+    return EncryptBuffer(buffer, length, capacity, context->cipher);
+}
+
+size_t CascadeDecryptInPlace(const CascadeContext* context, uint8_t* buffer, size_t length) {
+    CountStat(Stat::CALLS);
+    return DecryptBuffer(buffer, length, context->cipher);
+}
+
+size_t CascadeBufferBound(const CascadeContext* context, size_t length) {
+    return EncryptedBufferSize(length, context->cipher);
+}
+
+vector<uint32_t> CascadeEncryptTable(const string& key) {
+    return GetCascadeTables(ParseCascadeKey(key))->encrypt;
+}
+
+const CipherPlugin* CipherPluginDescriptor() {
+    static const CipherPlugin plugin = {
+        CIPHER_PLUGIN_VERSION, 4, CASCADE_NAME, "Каскад шифров", "КАСКАД ШИФРОВ", "каскада (шифр:ключ через запятую)",
+        CascadeTextEncrypt, CascadeTextDecrypt,
+        CascadeFileEncrypt, CascadeFileDecrypt, CascadeFileEncryptFramed, CascadeDecryptRange,
+        CascadeStreamEncrypt, CascadeStreamDecrypt,
+        GenerateCascadeKey, CascadeSetChunkSize, CascadeSetIoBackend, CascadeSetThreadCount,
+        CascadeGetAsyncIoStats, CascadeGetStats, CascadeResetStats, CascadeSetStatsEnabled,
+        CascadeEncryptTable
+    };
+    return &plugin;
+}
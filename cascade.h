@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "plugin.h"
+
+#define CASCADE_API
+
+// Каскад шифров: несколько шифров, применяемых по очереди. Ключ каскада - список шагов
+// "шифр:ключ" через запятую, например "permutation:3-1-4-2,matrix:5,magicsquare:5"; шифры
+// берутся из библиотек каталога, в котором лежит эта. Все шаги - перестановки байт внутри
+// блоков, поэтому при создании каскада они составляются в одну таблицу на блок размера НОК
+// размеров блоков шагов, и файл шифруется за один проход вместо одного прохода на шаг.
+// Для данных длины, кратной блоку каскада, результат совпадает с последовательным
+// шифрованием шагами; последний неполный блок дополняется нулями до блока каскада.
+// Текст шифруется шагами по очереди: размер квадрата у текстовых шифров зависит от длины
+// сообщения, и общей таблицы для них нет
+struct CascadeContext;
+
+// Шаг каскада: короткое имя шифра и ключ для него
+struct CascadeStage {
+    std::string cipher;
+    std::string key;
+};
+
+// Наибольший размер блока каскада: таблицы обоих направлений занимают по 4 байта на байт блока
+const size_t MAX_CASCADE_BLOCK_SIZE = 4 << 20;
+
+extern "C" {
+    // Ключ каскада из списка шагов в порядке применения при шифровании
+    CASCADE_API std::string CascadeMakeKey(const std::vector<CascadeStage>& stages);
+    CASCADE_API std::string CascadeTextEncrypt(const std::string& text, const std::string& key);
+    CASCADE_API std::string CascadeTextDecrypt(const std::string& text, const std::string& key);
+    // Контекст составляется один раз на ключ и используется для любого числа сообщений и файлов
+    CASCADE_API CascadeContext* CascadeCreateContext(const std::string& key);
+    CASCADE_API std::string CascadeEncryptWithContext(const CascadeContext* context, const std::string& text);
+    CASCADE_API std::string CascadeDecryptWithContext(const CascadeContext* context, const std::string& text);
+    CASCADE_API void CascadeFileEncryptWithContext(const CascadeContext* context, const std::string& inPath, const std::string& outPath);
+    CASCADE_API void CascadeFileDecryptWithContext(const CascadeContext* context, const std::string& inPath, const std::string& outPath);
+    // Размер блока каскада (НОК размеров блоков шагов)
+    CASCADE_API size_t CascadeBlockSize(const CascadeContext* context);
+    CASCADE_API void CascadeDestroyContext(CascadeContext* context);
+    CASCADE_API void CascadeFileEncrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Шифрование в контейнер с заголовком, хранящим исходную длину; FileDecrypt распознаёт его сам
+    CASCADE_API void CascadeFileEncryptFramed(const std::string& inPath, const std::string& outPath, const std::string& key);
+    CASCADE_API void CascadeFileDecrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Потоковая обработка открытых дескрипторов (каналов, stdin/stdout); дескрипторы не закрываются
+    CASCADE_API void CascadeStreamEncrypt(int inFd, int outFd, const std::string& key);
+    CASCADE_API void CascadeStreamDecrypt(int inFd, int outFd, const std::string& key);
+    // Расшифрование байт [offset, offset + length) исходного файла с чтением только нужных блоков;
+    // возвращает количество записанных в out байт
+    CASCADE_API size_t CascadeDecryptRange(const std::string& inPath, const std::string& key, uint64_t offset, uint64_t length, uint8_t* out);
+    // Шифрование данных в памяти на месте, без выделения памяти: buffer[0, length) дополняется
+    // нулями до целого блока и переставляется внутри buffer. Вызывающий может сразу выделить
+    // CascadeBufferBound байт; при меньшем capacity бросается length_error. Возвращает длину результата
+    CASCADE_API size_t CascadeEncryptInPlace(const CascadeContext* context, uint8_t* buffer, size_t length, size_t capacity);
+    // Расшифрование на месте; length кратна размеру блока. Возвращает длину данных без нулей
+    // в конце, как при расшифровании файла без заголовка
+    CASCADE_API size_t CascadeDecryptInPlace(const CascadeContext* context, uint8_t* buffer, size_t length);
+    // Размер буфера для шифрования length байт на месте
+    CASCADE_API size_t CascadeBufferBound(const CascadeContext* context, size_t length);
+    // Каскад из случайных ключей всех остальных шифров каталога в порядке меню
+    CASCADE_API std::string GenerateCascadeKey();
+    // Размер порции потоковой обработки файлов (по умолчанию 4 МБ); 0 - обработка файла целиком
+    CASCADE_API void CascadeSetChunkSize(size_t bytes);
+    // Механизм файлового ввода-вывода: "stream" (по умолчанию), "whole", "mmap", "mmap-huge",
+    // "uring" или "uring:N" - асинхронный ввод-вывод с глубиной очереди N
+    CASCADE_API void CascadeSetIoBackend(const std::string& name);
+    // Количество потоков поблочной обработки (по умолчанию 1); 0 - по числу ядер
+    CASCADE_API void CascadeSetThreadCount(unsigned count);
+    // Статистика очереди механизма "uring" для последней файловой операции этого потока
+    CASCADE_API AsyncIoStats CascadeGetAsyncIoStats();
+    // Счётчики вызовов, объёмов и времени по фазам, сумма по всем потокам; сбор включается
+    // SetStatsEnabled или переменной окружения CRYPTOGRAPHY_STATS. Время составления таблиц
+    // входит в разбор ключа; текст считают библиотеки шагов
+    CASCADE_API CipherStats CascadeGetStats();
+    CASCADE_API void CascadeResetStats();
+    CASCADE_API void CascadeSetStatsEnabled(bool enabled);
+    // Составная таблица выборки шифрования блока каскада
+    CASCADE_API std::vector<uint32_t> CascadeEncryptTable(const std::string& key);
+    // Описание шифра для реестра библиотек программы
+    CASCADE_API const CipherPlugin* CipherPluginDescriptor();
+}
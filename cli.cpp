@@ -0,0 +1,430 @@
+#include "cli.h"
+#include "registry.h"
+#include "cpudispatch.h"
+#include "stats.h"
+#include "trace.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Библиотека, которой передаются шаги --stage
+const char* const CASCADE_CIPHER = "cascade";
+
+struct BatchOptions {
+    string cipherName;
+    string key;
+    bool keySet = false;
+    vector<string> stages; // шаги каскада "шифр:ключ" из --stage
+    int direction = 0; // 1 - шифрование, -1 - расшифрование
+    bool textMode = false;
+    bool framed = false;
+    unsigned jobs = 0;
+    unsigned blockThreads = 1;
+    bool chunkSet = false;
+    size_t chunkSize = 0;
+    string ioBackend;
+    string outDirectory;
+    string libDirectory = DEFAULT_LIB_DIRECTORY;
+    vector<string> inputs;
+    bool filter = false; // ни файлов, ни каталога: стандартный ввод в стандартный вывод
+};
+
+struct FileResult {
+    bool ok = false;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    string error;
+    string ioStats; // загрузка очереди механизма uring
+};
+
+void PrintUsage(ostream& out) {
+    out << "Использование:\n"
+        << "  cryptography --cipher ИМЯ --key КЛЮЧ (--encrypt | --decrypt) [параметры] ФАЙЛ... -o КАТАЛОГ\n"
+        << "  cryptography --cipher ИМЯ --key КЛЮЧ (--encrypt | --decrypt) [параметры] < ВХОД > ВЫХОД\n"
+        << "  cryptography --stage ИМЯ:КЛЮЧ [--stage ИМЯ:КЛЮЧ]... (--encrypt | --decrypt) [параметры] ...\n"
+        << "Без файлов и каталога программа работает как фильтр: читает стандартный ввод\n"
+        << "и пишет результат в стандартный вывод.\n"
+        << "Параметры:\n"
+        << "  --cipher ИМЯ      шифр: имя библиотеки (permutation, matrix, magicsquare, ...)\n"
+        << "  --key КЛЮЧ        ключ шифра\n"
+        << "  --stage ИМЯ:КЛЮЧ  шаг каскада шифров; шаги применяются в порядке указания за один проход\n"
+        << "                    по файлу (то же, что --cipher cascade --key ИМЯ:КЛЮЧ,ИМЯ:КЛЮЧ,...)\n"
+        << "  --encrypt         зашифровать файлы\n"
+        << "  --decrypt         расшифровать файлы\n"
+        << "  --text            обрабатывать файлы как текст UTF-8, а не как двоичные данные\n"
+        << "  --framed          шифровать в контейнер с заголовком (двоичный режим)\n"
+        << "  -o, --output КАТ  каталог для результатов; имена файлов сохраняются\n"
+        << "  -j, --jobs N      количество одновременно обрабатываемых файлов (по умолчанию по числу ядер)\n"
+        << "  --threads N       потоков на обработку одного файла (по умолчанию 1; 0 - по числу ядер)\n"
+        << "  --chunk БАЙТ      размер порции потоковой обработки; 0 - файл целиком\n"
+        << "  --io МЕХАНИЗМ     ввод-вывод файлов: stream (по умолчанию), whole, mmap, mmap-huge,\n"
+        << "                    uring[:N] - асинхронно через io_uring с глубиной очереди N (по умолчанию 8)\n"
+        << "  --lib-dir КАТ     каталог библиотек шифров (по умолчанию " << DEFAULT_LIB_DIRECTORY << ")\n"
+        << "  -h, --help        эта справка\n"
+        << "Пароль доступа передаётся в переменной окружения " << PASSWORD_ENV << ".\n"
+        << "Вариант векторных ядер (scalar, sse4.2, avx2, avx512, avx512vbmi) можно задать переменной "
+        << ISA_ENV << ".\n"
+        << "Счётчики библиотек (вызовы, объёмы, время чтения, преобразования и записи) собираются, если задана\n"
+        << "переменная " << STATS_ENV << "; значение, отличное от 1, - файл, куда при выходе дописывается JSON.\n"
+        << "Фазы обработки записываются в формате Chrome trace в файл из переменной " << TRACE_ENV << ";\n"
+        << "точки USDT cryptography:phase_start и phase_done доступны perf и bpftrace всегда.\n";
+}
+
+unsigned long long ParseNumber(const string& option, const string& value) {
+    try {
+        size_t used = 0;
+        unsigned long long number = stoull(value, &used);
+        if (used != value.size() || value[0] == '-') {
+            throw invalid_argument(value);
+        }
+        return number;
+    } catch (const exception&) {
+        throw invalid_argument("Параметр " + option + " ожидает неотрицательное число, получено: " + value);
+    }
+}
+
+BatchOptions ParseArguments(int argc, char* argv[]) {
+    BatchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw invalid_argument("Для параметра " + arg + " не указано значение");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--cipher") {
+            options.cipherName = value();
+        } else if (arg == "--key") {
+            options.key = value();
+            options.keySet = true;
+        } else if (arg == "--stage") {
+            options.stages.push_back(value());
+        } else if (arg == "--encrypt" || arg == "--decrypt") {
+            int direction = (arg == "--encrypt") ? 1 : -1;
+            if (options.direction != 0 && options.direction != direction) {
+                throw invalid_argument("Параметры --encrypt и --decrypt несовместимы");
+            }
+            options.direction = direction;
+        } else if (arg == "--text") {
+            options.textMode = true;
+        } else if (arg == "--framed") {
+            options.framed = true;
+        } else if (arg == "-o" || arg == "--output") {
+            options.outDirectory = value();
+        } else if (arg == "-j" || arg == "--jobs") {
+            options.jobs = static_cast<unsigned>(ParseNumber(arg, value()));
+        } else if (arg == "--threads") {
+            options.blockThreads = static_cast<unsigned>(ParseNumber(arg, value()));
+        } else if (arg == "--chunk") {
+            options.chunkSize = static_cast<size_t>(ParseNumber(arg, value()));
+            options.chunkSet = true;
+        } else if (arg == "--io") {
+            options.ioBackend = value();
+        } else if (arg == "--lib-dir") {
+            options.libDirectory = value();
+        } else if (arg == "--") {
+            for (++i; i < argc; ++i) {
+                options.inputs.push_back(argv[i]);
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            throw invalid_argument("Неизвестный параметр: " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (!options.stages.empty()) {
+        if (options.keySet || (!options.cipherName.empty() && options.cipherName != CASCADE_CIPHER)) {
+            throw invalid_argument("Параметр --stage задаёт шифр и ключ сам и несовместим с --cipher и --key");
+        }
+        options.cipherName = CASCADE_CIPHER;
+        for (const auto& stage : options.stages) {
+            options.key += (options.key.empty() ? "" : ",") + stage;
+        }
+        options.keySet = true;
+    }
+    if (options.cipherName.empty()) {
+        throw invalid_argument("Не указан шифр (--cipher)");
+    }
+    if (!options.keySet || options.key.empty()) {
+        throw invalid_argument("Не указан ключ (--key)");
+    }
+    if (options.direction == 0) {
+        throw invalid_argument("Не указано действие (--encrypt или --decrypt)");
+    }
+    options.filter = options.inputs.empty() && options.outDirectory.empty();
+    if (!options.filter && options.outDirectory.empty()) {
+        throw invalid_argument("Не указан каталог для результатов (-o)");
+    }
+    if (!options.filter && options.inputs.empty()) {
+        throw invalid_argument("Не указаны входные файлы");
+    }
+    if (options.framed && (options.textMode || options.direction < 0)) {
+        throw invalid_argument("Параметр --framed применим только к шифрованию двоичных файлов");
+    }
+    if (options.framed && options.filter) {
+        throw invalid_argument("Параметр --framed требует выходного файла: заголовок записывается после шифрования");
+    }
+    if (options.jobs == 0) {
+        options.jobs = max(1u, thread::hardware_concurrency());
+    }
+    return options;
+}
+
+void ProcessText(const CipherPlugin& cipher, const BatchOptions& options, const string& inPath, const string& outPath) {
+    ifstream inputFile(inPath);
+    if (!inputFile) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    string content;
+    {
+        TraceSpan span("read");
+        content.assign(istreambuf_iterator<char>(inputFile), istreambuf_iterator<char>());
+        span.SetBytes(content.size());
+    }
+    inputFile.close();
+
+    string result;
+    {
+        TraceSpan span("transform", content.size());
+        result = (options.direction > 0) ? cipher.textEncrypt(content, options.key) : cipher.textDecrypt(content, options.key);
+    }
+
+    ofstream outputFile(outPath);
+    if (!outputFile) {
+        throw runtime_error("Не удалось создать выходной файл: " + outPath);
+    }
+    TraceSpan span("write", result.size());
+    outputFile << result;
+    if (!outputFile.flush()) {
+        throw runtime_error("Ошибка записи в файл: " + outPath);
+    }
+}
+
+FileResult ProcessFile(const CipherPlugin& cipher, const BatchOptions& options, const string& inPath, const string& outPath) {
+    FileResult result;
+    auto start = chrono::steady_clock::now();
+    try {
+        error_code code;
+        uintmax_t size = fs::file_size(inPath, code);
+        if (code) {
+            throw runtime_error("Не удалось открыть входной файл: " + inPath);
+        }
+        result.bytes = size;
+
+        if (options.textMode) {
+            ProcessText(cipher, options, inPath, outPath);
+        } else if (options.direction < 0) {
+            cipher.fileDecrypt(inPath, outPath, options.key);
+        } else if (options.framed) {
+            cipher.fileEncryptFramed(inPath, outPath, options.key);
+        } else {
+            cipher.fileEncrypt(inPath, outPath, options.key);
+        }
+        result.ok = true;
+    } catch (const exception& e) {
+        result.error = e.what();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+double Megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+// Выходные пути: каталог результатов плюс имя входного файла. Совпадающие имена
+// и запись поверх входного файла отклоняются до начала обработки
+vector<string> BuildOutputPaths(const BatchOptions& options) {
+    vector<string> outputs;
+    set<string> names;
+    for (const auto& input : options.inputs) {
+        fs::path name = fs::path(input).filename();
+        if (name.empty()) {
+            throw invalid_argument("Не является файлом: " + input);
+        }
+        if (!names.insert(name.string()).second) {
+            throw invalid_argument("Несколько входных файлов с именем " + name.string());
+        }
+
+        fs::path output = fs::path(options.outDirectory) / name;
+        error_code code;
+        if (fs::equivalent(input, output, code)) {
+            throw invalid_argument("Результат перезаписал бы входной файл: " + input);
+        }
+        outputs.push_back(output.string());
+    }
+    return outputs;
+}
+
+int RunFiles(const CipherPlugin& cipher, const BatchOptions& options, const vector<string>& outputs) {
+    error_code code;
+    fs::create_directories(options.outDirectory, code);
+    if (code) {
+        cerr << "ОШИБКА! Не удалось создать каталог " << options.outDirectory << ": " << code.message() << endl;
+        return 2;
+    }
+
+    // Пул потоков по файлам: каждый поток берёт следующий необработанный файл
+    size_t fileCount = options.inputs.size();
+    vector<FileResult> results(fileCount);
+    atomic<size_t> nextFile(0);
+    mutex outputMutex;
+    auto worker = [&]() {
+        for (size_t i = nextFile++; i < fileCount; i = nextFile++) {
+            results[i] = ProcessFile(cipher, options, options.inputs[i], outputs[i]);
+            // Статистика очереди хранится в потоке, выполнившем операцию
+            bool uring = options.ioBackend.compare(0, 5, "uring") == 0;
+            if (results[i].ok && uring && !options.textMode && !options.framed) {
+                AsyncIoStats stats = cipher.getAsyncIoStats();
+                char line[128];
+                snprintf(line, sizeof(line), ", очередь %.1f/%u из %u%s", stats.averageInFlight, stats.maxInFlight,
+                         stats.queueDepth, stats.fallback ? " (pread/pwrite)" : "");
+                results[i].ioStats = line;
+            }
+
+            lock_guard<mutex> lock(outputMutex);
+            if (results[i].ok) {
+                char line[128];
+                snprintf(line, sizeof(line), ": %llu байт, %.3f с, %.1f МБ/с",
+                         static_cast<unsigned long long>(results[i].bytes), results[i].seconds,
+                         results[i].seconds > 0 ? Megabytes(results[i].bytes) / results[i].seconds : 0.0);
+                cout << options.inputs[i] << " -> " << outputs[i] << line << results[i].ioStats << endl;
+            } else {
+                cerr << "ОШИБКА! " << options.inputs[i] << ": " << results[i].error << endl;
+            }
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    unsigned jobs = static_cast<unsigned>(min<size_t>(options.jobs, fileCount));
+    vector<thread> threads;
+    for (unsigned i = 1; i < jobs; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    uint64_t totalBytes = 0;
+    for (const auto& result : results) {
+        if (result.ok) {
+            totalBytes += result.bytes;
+        } else {
+            ++failed;
+        }
+    }
+
+    char summary[160];
+    snprintf(summary, sizeof(summary), "Итого: %zu из %zu файлов, %.1f МБ за %.3f с, %.1f МБ/с, потоков: %u",
+             fileCount - failed, fileCount, Megabytes(totalBytes), seconds,
+             seconds > 0 ? Megabytes(totalBytes) / seconds : 0.0, jobs);
+    cout << summary << endl;
+
+    return failed == 0 ? 0 : 1;
+}
+
+// Режим фильтра: двоичные данные обрабатываются порциями по мере поступления,
+// текст читается целиком, так как разбиение на блоки зависит от всей длины
+int RunFilter(const CipherPlugin& cipher, const BatchOptions& options) {
+    try {
+        if (options.textMode) {
+            string content((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+            string result;
+            {
+                TraceSpan span("transform", content.size());
+                result = (options.direction > 0) ? cipher.textEncrypt(content, options.key) : cipher.textDecrypt(content, options.key);
+            }
+            cout << result;
+            if (!cout.flush()) {
+                throw runtime_error("Ошибка записи в стандартный вывод");
+            }
+        } else if (options.direction > 0) {
+            cipher.streamEncrypt(STDIN_FILENO, STDOUT_FILENO, options.key);
+        } else {
+            cipher.streamDecrypt(STDIN_FILENO, STDOUT_FILENO, options.key);
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int RunBatchMode(int argc, char* argv[]) {
+    BatchOptions options;
+    vector<string> outputs;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (string(argv[i]) == "-h" || string(argv[i]) == "--help") {
+                PrintUsage(cout);
+                return 0;
+            }
+        }
+        options = ParseArguments(argc, argv);
+        outputs = BuildOutputPaths(options);
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << "\n\n";
+        PrintUsage(cerr);
+        return 2;
+    }
+
+    const char* password = getenv(PASSWORD_ENV);
+    if (!password || !CheckPassword(password)) {
+        cerr << "ОШИБКА! Доступ запрещён: неверный пароль в переменной окружения " << PASSWORD_ENV << endl;
+        return 2;
+    }
+
+    CipherRegistry registry;
+    vector<string> loadErrors;
+    registry.LoadDirectory(options.libDirectory, loadErrors);
+    const CipherPlugin* cipher = registry.Find(options.cipherName);
+    if (!cipher) {
+        for (const auto& error : loadErrors) {
+            cerr << "ОШИБКА! " << error << endl;
+        }
+        cerr << "ОШИБКА! Шифр " << options.cipherName << " не найден в каталоге " << options.libDirectory << endl;
+        return 2;
+    }
+
+    cipher->setThreadCount(options.blockThreads);
+    if (options.chunkSet) {
+        cipher->setChunkSize(options.chunkSize);
+    }
+    if (!options.ioBackend.empty()) {
+        try {
+            cipher->setIoBackend(options.ioBackend);
+        } catch (const exception& e) {
+            cerr << "ОШИБКА! " << e.what() << endl;
+            return 2;
+        }
+    }
+
+    if (options.filter) {
+        return RunFilter(*cipher, options);
+    }
+    return RunFiles(*cipher, options, outputs);
+}
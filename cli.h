@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+
+// Пароль доступа к программе: в меню он вводится с клавиатуры,
+// в пакетном режиме берётся из переменной окружения PASSWORD_ENV
+const char* const PASSWORD_ENV = "CRYPTOGRAPHY_PASSWORD";
+
+inline bool CheckPassword(const std::string& password) {
+    return password == "123";
+}
+
+// Пакетный режим без меню, например:
+//   cryptography --cipher matrix --key 7 --encrypt -j 4 in1 in2 -o outdir
+// Файлы обрабатываются параллельно библиотеками, загруженными один раз.
+// Без файлов программа работает как фильтр стандартного ввода в стандартный вывод:
+//   tar c dir | cryptography --cipher permutation --key 3-1-4-2 --encrypt | zstd > out
+// Несколько шифров подряд применяются каскадом за один проход по файлу:
+//   cryptography --stage permutation:3-1-4-2 --stage matrix:5 --encrypt in -o outdir
+// Возвращает код завершения программы
+int RunBatchMode(int argc, char* argv[]);
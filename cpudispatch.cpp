@@ -0,0 +1,59 @@
+#include "cpudispatch.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const IsaLevel LEVELS[] = {IsaLevel::SCALAR, IsaLevel::SSE42, IsaLevel::AVX2, IsaLevel::AVX512, IsaLevel::AVX512VBMI};
+
+static IsaLevel DetectIsaLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return __builtin_cpu_supports("avx512vbmi") ? IsaLevel::AVX512VBMI : IsaLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return IsaLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.2")) {
+        return IsaLevel::SSE42;
+    }
+#endif
+    return IsaLevel::SCALAR;
+}
+
+static IsaLevel SelectIsaLevel() {
+    IsaLevel detected = DetectIsaLevel();
+    const char* forced = getenv(ISA_ENV);
+    if (!forced) {
+        return detected;
+    }
+    for (IsaLevel level : LEVELS) {
+        if (strcmp(forced, IsaLevelName(level)) == 0) {
+            return min(level, detected);
+        }
+    }
+    return detected;
+}
+
+IsaLevel GetIsaLevel() {
+    static const IsaLevel level = SelectIsaLevel();
+    return level;
+}
+
+const char* IsaLevelName(IsaLevel level) {
+    switch (level) {
+        case IsaLevel::SCALAR:
+            return "scalar";
+        case IsaLevel::SSE42:
+            return "sse4.2";
+        case IsaLevel::AVX2:
+            return "avx2";
+        case IsaLevel::AVX512:
+            return "avx512";
+        case IsaLevel::AVX512VBMI:
+            return "avx512vbmi";
+    }
+    return "scalar";
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Набор инструкций для векторных ядер, по возрастанию
+enum class IsaLevel {
+    SCALAR,     // без векторных ядер
+    SSE42,      // SSSE3 и SSE4.1/4.2
+    AVX2,
+    AVX512,     // AVX-512 F и BW
+    AVX512VBMI  // AVX-512 VBMI: произвольная перестановка байт в 64-байтном регистре
+};
+
+// Переменная окружения для выбора варианта ядер, например для сравнения производительности:
+// "scalar", "sse4.2", "avx2", "avx512" или "avx512vbmi"
+const char* const ISA_ENV = "CRYPTOGRAPHY_ISA";
+
+// Уровень, определяемый один раз по cpuid. Уровень из ISA_ENV применяется, только если
+// процессор его поддерживает: иначе остаётся наибольший доступный; неизвестное имя не учитывается
+IsaLevel GetIsaLevel();
+
+const char* IsaLevelName(IsaLevel level);
@@ -0,0 +1,201 @@
+#include "fdstream.h"
+#include "stats.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+size_t ReadFull(int fd, uint8_t* buffer, size_t size, const string& name) {
+    StatTimer timer(Stat::READ_NS, size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = read(fd, buffer + done, size - done);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Ошибка чтения входного файла: " + name + ": " + strerror(errno));
+        }
+        if (got == 0) {
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    CountStat(Stat::BYTES_IN, done);
+    return done;
+}
+
+void WriteFull(int fd, const uint8_t* buffer, size_t size, const string& name) {
+    StatTimer timer(Stat::WRITE_NS, size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t put = write(fd, buffer + done, size - done);
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Ошибка записи в выходной файл: " + name + ": " + strerror(errno));
+        }
+        done += static_cast<size_t>(put);
+    }
+    CountStat(Stat::BYTES_OUT, size);
+}
+
+ChunkReader::ChunkReader(int fd, size_t chunk, const string& name, const uint8_t* prefix, size_t prefixLength)
+    : fd(fd), chunk(chunk), name(name) {
+    buffers[0].resize(chunk);
+    buffers[1].resize(chunk);
+    CountAllocation(chunk);
+    CountAllocation(chunk);
+    vector<uint8_t> pending(prefix, prefix + prefixLength);
+    thread = std::thread([this, pending]() {
+        Run(pending);
+    });
+}
+
+ChunkReader::~ChunkReader() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+void ChunkReader::Run(const vector<uint8_t>& prefix) {
+    size_t prefixUsed = 0;
+    for (size_t index = 0;; index ^= 1) {
+        unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return stop || !filled[index]; });
+        if (stop) {
+            return;
+        }
+        lock.unlock();
+
+        size_t length = 0;
+        exception_ptr failure;
+        try {
+            uint8_t* buffer = buffers[index].data();
+            length = min(prefix.size() - prefixUsed, chunk);
+            copy(prefix.begin() + prefixUsed, prefix.begin() + prefixUsed + length, buffer);
+            prefixUsed += length;
+            length += ReadFull(fd, buffer + length, chunk - length, name);
+        } catch (...) {
+            failure = current_exception();
+        }
+
+        lock.lock();
+        lengths[index] = length;
+        filled[index] = true;
+        error = failure;
+        changed.notify_all();
+        if (failure || length < chunk) {
+            return;
+        }
+    }
+}
+
+uint8_t* ChunkReader::Next(size_t& length) {
+    unique_lock<std::mutex> lock(mutex);
+    if (finished) {
+        length = 0;
+        return nullptr;
+    }
+    if (holding) {
+        holding = false;
+        filled[current] = false;
+        current ^= 1;
+        changed.notify_all();
+    }
+
+    {
+        // Вызывающий ждёт чтения: обработка быстрее ввода-вывода
+        StatTimer timer(Stat::WAIT_NS);
+        changed.wait(lock, [&] { return filled[current]; });
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    holding = true;
+    length = lengths[current];
+    finished = length < chunk;
+    return buffers[current].data();
+}
+
+ChunkWriter::ChunkWriter(int fd, size_t chunk, const string& name) : fd(fd), name(name) {
+    buffers[0].resize(chunk);
+    buffers[1].resize(chunk);
+    CountAllocation(chunk);
+    CountAllocation(chunk);
+    thread = std::thread([this]() {
+        Run();
+    });
+}
+
+ChunkWriter::~ChunkWriter() {
+    if (thread.joinable()) {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+}
+
+void ChunkWriter::Run() {
+    for (size_t index = 0;; index ^= 1) {
+        unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return stop || full[index]; });
+        if (!full[index]) {
+            return;
+        }
+        lock.unlock();
+
+        exception_ptr failure;
+        try {
+            WriteFull(fd, buffers[index].data(), lengths[index], name);
+        } catch (...) {
+            failure = current_exception();
+        }
+
+        lock.lock();
+        full[index] = false;
+        error = failure;
+        changed.notify_all();
+        if (failure) {
+            return;
+        }
+    }
+}
+
+void ChunkWriter::WaitFree(size_t index, unique_lock<std::mutex>& lock) {
+    StatTimer timer(Stat::WAIT_NS);
+    changed.wait(lock, [&] { return !full[index] || error; });
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void ChunkWriter::Submit(size_t length) {
+    unique_lock<std::mutex> lock(mutex);
+    lengths[current] = length;
+    full[current] = true;
+    changed.notify_all();
+    current ^= 1;
+    WaitFree(current, lock);
+}
+
+void ChunkWriter::Finish() {
+    {
+        unique_lock<std::mutex> lock(mutex);
+        WaitFree(0, lock);
+        WaitFree(1, lock);
+        stop = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// Дескриптор файла, закрываемый при выходе из области видимости
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    int Get() const { return fd; }
+
+private:
+    int fd;
+};
+
+// Читает size байт, повторяя короткие чтения (каналы отдают данные частями);
+// меньше size возвращается только в конце данных
+size_t ReadFull(int fd, uint8_t* buffer, size_t size, const std::string& name);
+
+// Записывает size байт целиком
+void WriteFull(int fd, const uint8_t* buffer, size_t size, const std::string& name);
+
+// Чтение порциями в отдельном потоке с двумя буферами: пока вызывающий обрабатывает
+// одну порцию, следующая уже читается. Работает с каналами и любыми дескрипторами
+class ChunkReader {
+public:
+    // prefix - уже прочитанные из fd байты, которые должны идти первыми
+    ChunkReader(int fd, size_t chunk, const std::string& name, const uint8_t* prefix = nullptr, size_t prefixLength = 0);
+    ~ChunkReader();
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    // Следующая порция: ровно chunk байт, меньше - только последняя, 0 - данные кончились.
+    // Буфер принадлежит вызывающему до следующего вызова Next
+    uint8_t* Next(size_t& length);
+
+private:
+    void Run(const std::vector<uint8_t>& prefix);
+
+    int fd;
+    size_t chunk;
+    std::string name;
+    std::vector<uint8_t> buffers[2];
+    size_t lengths[2] = {0, 0};
+    bool filled[2] = {false, false};
+    size_t current = 0;
+    bool holding = false;  // буфер current отдан вызывающему
+    bool finished = false; // вызывающий получил последнюю порцию
+    bool stop = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+};
+
+// Запись порциями в отдельном потоке с двумя буферами: пока одна порция записывается,
+// вызывающий заполняет следующую
+class ChunkWriter {
+public:
+    ChunkWriter(int fd, size_t chunk, const std::string& name);
+    ~ChunkWriter();
+    ChunkWriter(const ChunkWriter&) = delete;
+    ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+    // Свободный буфер размером chunk
+    uint8_t* Buffer() { return buffers[current].data(); }
+
+    // Отдаёт length байт буфера на запись и ждёт, пока освободится второй буфер
+    void Submit(size_t length);
+
+    // Дожидается записи всех порций; ошибка записи бросается отсюда или из Submit
+    void Finish();
+
+private:
+    void Run();
+    void WaitFree(size_t index, std::unique_lock<std::mutex>& lock);
+
+    int fd;
+    std::string name;
+    std::vector<uint8_t> buffers[2];
+    size_t lengths[2] = {0, 0};
+    bool full[2] = {false, false};
+    size_t current = 0;
+    bool stop = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+};
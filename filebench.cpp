@@ -0,0 +1,517 @@
+// Сквозное измерение обработки файлов: библиотеки шифров загружаются через dlopen,
+// как в программе, и шифруют и расшифровывают настоящие файлы на диске с холодным
+// и прогретым страничным кэшем. Корпус файлов воспроизводим: содержимое зависит
+// только от вида и размера. Запуск: make bench-files (параметры - FILEBENCH_ARGS)
+#include "registry.h"
+#include "benchutil.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const vector<string> ALL_KINDS = {"sparse", "dense", "text", "binary"};
+
+struct FileBenchOptions {
+    string libDirectory = DEFAULT_LIB_DIRECTORY;
+    string cipherName;
+    string key;
+    string corpusDirectory = "/tmp/filebench";
+    string ioBackend;
+    string jsonPath;
+    string label;
+    vector<uint64_t> sizes = {4 << 10, 1 << 20, 64 << 20, 1ULL << 30};
+    vector<string> kinds = ALL_KINDS;
+    unsigned repeat = 1;
+    bool keepCorpus = false;
+};
+
+// Показатели одной операции
+struct OpMeasurement {
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    double ioWaitSeconds = 0;   // ожидание блочного ввода-вывода процессом (delay accounting)
+    double systemIoWait = 0;    // iowait всей системы за время операции, с
+    CipherStats stats = {};     // счётчики библиотеки за операцию: время чтения, преобразования, записи
+};
+
+struct FileBenchResult {
+    string cipher;
+    string key;
+    string kind;
+    uint64_t bytes;
+    string cache;     // "cold" или "warm"
+    string operation; // "encrypt" или "decrypt"
+    OpMeasurement measurement;
+    bool roundTripOk;
+};
+
+void PrintUsage(ostream& out) {
+    out << "Использование: filebench [параметры]\n"
+        << "  --lib-dir КАТ     каталог библиотек шифров (по умолчанию " << DEFAULT_LIB_DIRECTORY << ")\n"
+        << "  --cipher ИМЯ      только один шифр\n"
+        << "  --key КЛЮЧ        ключ (вместе с --cipher); иначе ключ по умолчанию для каждого шифра\n"
+        << "  --dir КАТ         каталог корпуса и результатов (по умолчанию /tmp/filebench)\n"
+        << "  --sizes СПИСОК    размеры файлов через запятую с суффиксами K, M, G\n"
+        << "                    (по умолчанию 4K,1M,64M,1G)\n"
+        << "  --kinds СПИСОК    виды файлов: sparse, dense, text, binary (по умолчанию все)\n"
+        << "  --io МЕХАНИЗМ     механизм ввода-вывода библиотек (stream, whole, mmap, uring[:N], ...)\n"
+        << "  --repeat N        повторов каждого измерения, берётся лучшее (по умолчанию 1)\n"
+        << "  --keep            не удалять корпус после измерений\n"
+        << "  --json ФАЙЛ       записать результаты в JSON\n"
+        << "  --label ТЕКСТ     метка запуска в JSON, например хеш коммита\n";
+}
+
+uint64_t ParseSize(const string& text) {
+    size_t used = 0;
+    uint64_t value = stoull(text, &used);
+    string suffix = text.substr(used);
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    } else if (!suffix.empty()) {
+        throw invalid_argument("Неверный размер: " + text);
+    }
+    if (value == 0) {
+        throw invalid_argument("Размер файла должен быть больше нуля: " + text);
+    }
+    return value;
+}
+
+vector<string> SplitList(const string& text) {
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+string SizeName(uint64_t size) {
+    if (size % (1 << 30) == 0) {
+        return to_string(size >> 30) + "G";
+    }
+    if (size % (1 << 20) == 0) {
+        return to_string(size >> 20) + "M";
+    }
+    if (size % (1 << 10) == 0) {
+        return to_string(size >> 10) + "K";
+    }
+    return to_string(size);
+}
+
+// Ключ по умолчанию: средний размер блока каждого шифра
+string DefaultKey(const CipherPlugin& cipher) {
+    string name = cipher.name;
+    if (name == "permutation") {
+        return "3-1-4-2-6-5-8-7";
+    }
+    if (name == "matrix") {
+        return "8";
+    }
+    if (name == "magicsquare") {
+        return "7";
+    }
+    if (name == "cascade") {
+        return "permutation:3-1-4-2-6-5-8-7,matrix:8,magicsquare:7";
+    }
+    return cipher.generateKey();
+}
+
+void WriteAll(int fd, const uint8_t* data, size_t size, const string& path) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            throw runtime_error("Ошибка записи в файл: " + path);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// Порция корпуса: sparse - 4 КБ данных на каждый мегабайт, остальное - дыры; dense -
+// случайные байты; text - ASCII-слова и строки; binary - записи с небольшими числами
+// и нулевыми полями. Последний байт файла ненулевой: расшифрование файла без заголовка
+// отбрасывает нули в конце, и иначе проверка обратного преобразования не прошла бы
+void GenerateCorpusFile(const string& path, const string& kind, uint64_t size) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw runtime_error("Не удалось создать файл корпуса: " + path);
+    }
+    mt19937_64 random(hash<string>()(kind) ^ size);
+    const size_t piece = 1 << 20;
+    vector<uint8_t> buffer(piece);
+    const char* words[] = {"файл", "block", "cipher", "matrix", "данные", "spiral", "the", "of", "and", "ключ"};
+
+    try {
+        for (uint64_t offset = 0; offset < size; offset += piece) {
+            size_t length = static_cast<size_t>(min<uint64_t>(piece, size - offset));
+            if (kind == "sparse") {
+                size_t dataLength = min<size_t>(4096, length);
+                for (size_t i = 0; i < dataLength; ++i) {
+                    buffer[i] = static_cast<uint8_t>(random());
+                }
+                WriteAll(fd, buffer.data(), dataLength, path);
+                if (lseek(fd, static_cast<off_t>(length - dataLength), SEEK_CUR) < 0) {
+                    throw runtime_error("Ошибка записи в файл: " + path);
+                }
+                continue;
+            }
+            if (kind == "dense") {
+                for (size_t i = 0; i < length; i += 8) {
+                    uint64_t word = random();
+                    memcpy(buffer.data() + i, &word, min<size_t>(8, length - i));
+                }
+            } else if (kind == "text") {
+                size_t i = 0;
+                while (i < length) {
+                    const char* word = words[random() % 10];
+                    size_t wordLength = min(strlen(word), length - i);
+                    memcpy(buffer.data() + i, word, wordLength);
+                    i += wordLength;
+                    if (i < length) {
+                        buffer[i++] = random() % 12 == 0 ? '\n' : ' ';
+                    }
+                }
+            } else {
+                for (size_t i = 0; i < length; ++i) {
+                    size_t field = i % 16;
+                    buffer[i] = field < 4 ? static_cast<uint8_t>((offset + i) >> (8 * field)) :
+                                field < 8 ? static_cast<uint8_t>(random() % 16) : 0;
+                }
+            }
+            WriteAll(fd, buffer.data(), length, path);
+        }
+        // Последний байт
+        uint8_t last = 0x7F;
+        if (pwrite(fd, &last, 1, static_cast<off_t>(size - 1)) != 1) {
+            throw runtime_error("Ошибка записи в файл: " + path);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+uint64_t FileSize(const string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : UINT64_MAX;
+}
+
+// Страницы файла сбрасываются из кэша: данные сначала записываются на диск
+void DropFromCache(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// Файл читается целиком, чтобы его страницы оказались в кэше
+void WarmCache(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    vector<uint8_t> buffer(1 << 20);
+    while (read(fd, buffer.data(), buffer.size()) > 0) {
+    }
+    close(fd);
+}
+
+bool SameContents(const string& first, const string& second) {
+    ifstream a(first, ios::binary), b(second, ios::binary);
+    if (!a || !b) {
+        return false;
+    }
+    vector<char> bufferA(1 << 20), bufferB(1 << 20);
+    while (true) {
+        a.read(bufferA.data(), bufferA.size());
+        b.read(bufferB.data(), bufferB.size());
+        if (a.gcount() != b.gcount() || memcmp(bufferA.data(), bufferB.data(), a.gcount()) != 0) {
+            return false;
+        }
+        if (a.gcount() == 0) {
+            return true;
+        }
+    }
+}
+
+double CpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Ожидание блочного ввода-вывода процессом: поле 42 /proc/self/stat, в тиках.
+// Без включённого в ядре delay accounting всегда 0
+double ProcessIoWaitSeconds() {
+    ifstream stat("/proc/self/stat");
+    string content((istreambuf_iterator<char>(stat)), istreambuf_iterator<char>());
+    size_t end = content.rfind(')');
+    if (end == string::npos) {
+        return 0;
+    }
+    stringstream fields(content.substr(end + 2));
+    string field;
+    // После имени процесса идут поля с третьего; delayacct_blkio_ticks - 42-е
+    for (int index = 3; index <= 42 && fields >> field; ++index) {
+        if (index == 42) {
+            return stod(field) / sysconf(_SC_CLK_TCK);
+        }
+    }
+    return 0;
+}
+
+// iowait всей системы из /proc/stat, с
+double SystemIoWaitSeconds() {
+    ifstream stat("/proc/stat");
+    string cpu;
+    uint64_t user, nice, system, idle, iowait;
+    if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait)) {
+        return 0;
+    }
+    return static_cast<double>(iowait) / sysconf(_SC_CLK_TCK);
+}
+
+OpMeasurement MeasureOperation(const CipherPlugin& cipher, const function<void()>& operation) {
+    cipher.resetStats();
+    double cpu = CpuSeconds();
+    double ioWait = ProcessIoWaitSeconds();
+    double systemIoWait = SystemIoWaitSeconds();
+    auto start = chrono::steady_clock::now();
+    operation();
+
+    OpMeasurement result;
+    result.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.cpuSeconds = CpuSeconds() - cpu;
+    result.ioWaitSeconds = ProcessIoWaitSeconds() - ioWait;
+    result.systemIoWait = SystemIoWaitSeconds() - systemIoWait;
+    result.stats = cipher.getStats();
+    return result;
+}
+
+void PrintResult(const FileBenchResult& r) {
+    const OpMeasurement& m = r.measurement;
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s %-7s %6s %-5s %-8s %9.3f с  ЦП %8.3f с  %9.1f МБ/с  ожидание в/в %7.3f с (система %7.3f с)%s",
+             r.cipher.c_str(), r.kind.c_str(), SizeName(r.bytes).c_str(), r.cache.c_str(), r.operation.c_str(),
+             m.wallSeconds, m.cpuSeconds, m.wallSeconds > 0 ? r.bytes / m.wallSeconds / (1 << 20) : 0.0,
+             m.ioWaitSeconds, m.systemIoWait, r.roundTripOk ? "" : "  ОШИБКА: результат не совпал с исходным");
+    cout << line << endl;
+}
+
+void WriteJson(const string& path, const FileBenchOptions& options, const vector<FileBenchResult>& results) {
+    ofstream out(path);
+    out << "{\n  \"label\": " << JsonString(options.label) << ",\n"
+        << "  \"io_backend\": " << JsonString(options.ioBackend.empty() ? "stream" : options.ioBackend) << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const FileBenchResult& r = results[i];
+        const OpMeasurement& m = r.measurement;
+        char numbers[512];
+        snprintf(numbers, sizeof(numbers),
+                 "\"bytes\": %llu, \"wall_s\": %.6f, \"cpu_s\": %.6f, \"bytes_per_s\": %.0f, \"io_wait_s\": %.3f, "
+                 "\"system_io_wait_s\": %.3f, \"read_s\": %.6f, \"transform_s\": %.6f, \"write_s\": %.6f, "
+                 "\"stall_s\": %.6f, \"round_trip_ok\": %s",
+                 static_cast<unsigned long long>(r.bytes), m.wallSeconds, m.cpuSeconds,
+                 m.wallSeconds > 0 ? r.bytes / m.wallSeconds : 0.0, m.ioWaitSeconds, m.systemIoWait,
+                 m.stats.readNs / 1e9, m.stats.transformNs / 1e9, m.stats.writeNs / 1e9, m.stats.waitNs / 1e9,
+                 r.roundTripOk ? "true" : "false");
+        out << "    {\"cipher\": " << JsonString(r.cipher) << ", \"key\": " << JsonString(r.key)
+            << ", \"kind\": " << JsonString(r.kind) << ", \"cache\": " << JsonString(r.cache)
+            << ", \"operation\": " << JsonString(r.operation) << ", " << numbers << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    if (!out) {
+        throw runtime_error("Не удалось записать файл: " + path);
+    }
+}
+
+// Лучшее из repeat измерений по времени; перед каждым - холодный или прогретый кэш входа
+OpMeasurement BestOf(const CipherPlugin& cipher, unsigned repeat, const string& input, bool cold, const function<void()>& operation) {
+    OpMeasurement best;
+    for (unsigned i = 0; i < repeat; ++i) {
+        if (cold) {
+            DropFromCache(input);
+        } else {
+            WarmCache(input);
+        }
+        OpMeasurement current = MeasureOperation(cipher, operation);
+        if (i == 0 || current.wallSeconds < best.wallSeconds) {
+            best = current;
+        }
+    }
+    return best;
+}
+
+// Возвращает false, если хоть одно обратное преобразование не совпало с исходным файлом
+bool BenchCipher(const CipherPlugin& cipher, const FileBenchOptions& options, vector<FileBenchResult>& results) {
+    string key = options.key.empty() ? DefaultKey(cipher) : options.key;
+    bool allOk = true;
+
+    for (const string& kind : options.kinds) {
+        for (uint64_t size : options.sizes) {
+            string base = options.corpusDirectory + "/" + kind + "-" + SizeName(size);
+            string encrypted = base + "." + cipher.name + ".enc";
+            string decrypted = base + "." + cipher.name + ".dec";
+            if (FileSize(base) != size) {
+                GenerateCorpusFile(base, kind, size);
+            }
+
+            for (const string cache : {"cold", "warm"}) {
+                bool cold = cache == "cold";
+                OpMeasurement encryptTime = BestOf(cipher, options.repeat, base, cold, [&]() {
+                    cipher.fileEncrypt(base, encrypted, key);
+                });
+                // Запись результата на диск не входит в измерение следующей операции
+                DropFromCache(encrypted);
+                OpMeasurement decryptTime = BestOf(cipher, options.repeat, encrypted, cold, [&]() {
+                    cipher.fileDecrypt(encrypted, decrypted, key);
+                });
+                DropFromCache(decrypted);
+
+                bool ok = SameContents(base, decrypted);
+                allOk = allOk && ok;
+                results.push_back({cipher.name, key, kind, size, cache, "encrypt", encryptTime, ok});
+                PrintResult(results.back());
+                results.push_back({cipher.name, key, kind, size, cache, "decrypt", decryptTime, ok});
+                PrintResult(results.back());
+            }
+            remove(encrypted.c_str());
+            remove(decrypted.c_str());
+        }
+    }
+    return allOk;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    FileBenchOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto value = [&]() -> string {
+                if (i + 1 >= argc) {
+                    throw invalid_argument("Не указано значение параметра " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--lib-dir") {
+                options.libDirectory = value();
+            } else if (arg == "--cipher") {
+                options.cipherName = value();
+            } else if (arg == "--key") {
+                options.key = value();
+            } else if (arg == "--dir") {
+                options.corpusDirectory = value();
+            } else if (arg == "--sizes") {
+                options.sizes.clear();
+                for (const string& item : SplitList(value())) {
+                    options.sizes.push_back(ParseSize(item));
+                }
+            } else if (arg == "--kinds") {
+                options.kinds = SplitList(value());
+                for (const string& kind : options.kinds) {
+                    if (find(ALL_KINDS.begin(), ALL_KINDS.end(), kind) == ALL_KINDS.end()) {
+                        throw invalid_argument("Неизвестный вид файлов: " + kind);
+                    }
+                }
+            } else if (arg == "--io") {
+                options.ioBackend = value();
+            } else if (arg == "--repeat") {
+                options.repeat = static_cast<unsigned>(max(1, stoi(value())));
+            } else if (arg == "--keep") {
+                options.keepCorpus = true;
+            } else if (arg == "--json") {
+                options.jsonPath = value();
+            } else if (arg == "--label") {
+                options.label = value();
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(cout);
+                return 0;
+            } else {
+                throw invalid_argument("Неизвестный параметр: " + arg);
+            }
+        }
+        if (!options.key.empty() && options.cipherName.empty()) {
+            throw invalid_argument("Параметр --key требует --cipher");
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        PrintUsage(cerr);
+        return 2;
+    }
+
+    CipherRegistry registry;
+    vector<string> errors;
+    registry.LoadDirectory(options.libDirectory, errors);
+    for (const string& error : errors) {
+        cerr << "Предупреждение: " << error << endl;
+    }
+
+    vector<FileBenchResult> results;
+    bool allOk = true;
+    try {
+        mkdir(options.corpusDirectory.c_str(), 0755);
+        for (const LoadedCipher& loaded : registry.Ciphers()) {
+            const CipherPlugin& cipher = *loaded.plugin;
+            if (!options.cipherName.empty() && options.cipherName != cipher.name) {
+                continue;
+            }
+            if (!options.ioBackend.empty()) {
+                cipher.setIoBackend(options.ioBackend);
+            }
+            // Время фаз берётся из счётчиков библиотеки
+            cipher.setStatsEnabled(true);
+            allOk = BenchCipher(cipher, options, results) && allOk;
+        }
+        if (results.empty()) {
+            cerr << "ОШИБКА! Нет шифров для измерения в каталоге " << options.libDirectory << endl;
+            return 1;
+        }
+        if (!options.keepCorpus) {
+            for (const string& kind : options.kinds) {
+                for (uint64_t size : options.sizes) {
+                    remove((options.corpusDirectory + "/" + kind + "-" + SizeName(size)).c_str());
+                }
+            }
+        }
+        if (!options.jsonPath.empty()) {
+            WriteJson(options.jsonPath, options, results);
+            cout << "Результаты записаны в " << options.jsonPath << endl;
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        return 1;
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "vectorgather.h"
+
+// Ядро поблочной выборки, выбираемое по размеру блока во время выполнения
+using GatherKernel = void (*)(const uint8_t* src, uint8_t* dst, size_t length);
+
+struct GatherKernels {
+    GatherKernel encrypt;
+    GatherKernel decrypt;
+};
+
+// dst[block + k] = src[block + table[k]] для каждого целого блока. Размер блока известен
+// при компиляции: внутренний цикл с постоянным числом шагов разворачивается, а для таблиц
+// из constexpr-данных индексы становятся константами в коде
+template <size_t BlockSize, typename Index>
+inline void GatherFixed(const uint8_t* src, uint8_t* dst, size_t length, const Index* table) {
+    for (size_t block = 0; block + BlockSize <= length; block += BlockSize) {
+        const uint8_t* in = src + block;
+        uint8_t* out = dst + block;
+#pragma GCC unroll 64
+        for (size_t k = 0; k < BlockSize; k++) {
+            out[k] = in[table[k]];
+        }
+    }
+}
+
+// Блоки до MAX_VECTOR_GATHER_BLOCK байт сначала обрабатывает векторное ядро варианта,
+// выбранного при загрузке; byteTable - та же таблица в байтах. Остаток - GatherFixed
+template <size_t BlockSize, typename Index>
+inline void GatherFixedVector(const uint8_t* src, uint8_t* dst, size_t length, const Index* table, const uint8_t* byteTable) {
+    size_t done = 0;
+    if (BlockSize <= MAX_VECTOR_GATHER_BLOCK) {
+        done = GatherBlocksVector(src, dst, length, byteTable, BlockSize);
+    }
+    GatherFixed<BlockSize>(src + done, dst + done, length - done, table);
+}
+
+// Таблица выборки в байтах для векторных ядер; для блоков больше 256 байт не используется
+template <size_t BlockSize>
+constexpr std::array<uint8_t, BlockSize> ByteTable(const std::array<uint16_t, BlockSize>& table) {
+    std::array<uint8_t, BlockSize> bytes = {};
+    for (size_t k = 0; k < BlockSize; k++) {
+        bytes[k] = static_cast<uint8_t>(table[k]);
+    }
+    return bytes;
+}
+
+// Таблица ядер Kernel<First>, Kernel<First + Step>, ... для диспетчеризации по размеру:
+// Kernel<Size> - шаблон со статическими функциями Encrypt и Decrypt
+template <template <int> class Kernel, int First, int Step, size_t... Offsets>
+constexpr std::array<GatherKernels, sizeof...(Offsets)> MakeGatherKernels(std::index_sequence<Offsets...>) {
+    return {{{Kernel<First + Step * static_cast<int>(Offsets)>::Encrypt,
+              Kernel<First + Step * static_cast<int>(Offsets)>::Decrypt}...}};
+}
+
+// Блоки больше этого размера не помещаются в кэш второго уровня вместе с таблицами
+const size_t LARGE_PERMUTATION_BLOCK = 2 << 20;
+
+// Размер участка приёмника, который второй проход двухпроходной перестановки собирает целиком
+const size_t PERMUTATION_SEGMENT_SHIFT = 16;
+
+// Перестановка блоков произвольного размера по таблице выборки gather (dst[k] = src[gather[k]])
+// и обратной ей inverse; таблицы принадлежат вызывающему и должны жить дольше объекта.
+// Блок, помещающийся в кэш, или таблица, соседние элементы которой берутся из соседних строк
+// кэша (числа по строкам у квадратов порядка 4k), обходятся за один проход. Иначе, например
+// у спирали со стороной 2048, каждый байт - новая строка кэша и новая страница, а при
+// стороне, кратной странице, ещё и одно множество кэша. Такие блоки переставляются за два
+// прохода через буфер потока: первый читает источник подряд и раскладывает байты по участкам
+// приёмника в 64 КБ (не больше 256 потоков записи, каждый подряд), второй собирает каждый
+// участок из его части буфера, лежащей в кэше
+class BlockPermutation {
+public:
+    BlockPermutation(const std::vector<uint32_t>& gather, const std::vector<uint32_t>& inverse)
+        : gather(gather.data()), inverse(inverse.data()), blockSize(gather.size()) {
+        if (blockSize <= LARGE_PERMUTATION_BLOCK || !Scattered()) {
+            return;
+        }
+
+        size_t segment = size_t(1) << PERMUTATION_SEGMENT_SHIFT;
+        std::vector<size_t> next((blockSize + segment - 1) / segment);
+        for (size_t i = 0; i < next.size(); ++i) {
+            next[i] = i * segment;
+        }
+        route.resize(blockSize);
+        local.resize(blockSize);
+        for (size_t j = 0; j < blockSize; ++j) {
+            uint32_t k = inverse[j];
+            size_t part = k >> PERMUTATION_SEGMENT_SHIFT;
+            route[j] = static_cast<uint32_t>(next[part]);
+            local[k] = static_cast<uint16_t>(next[part] - part * segment);
+            ++next[part];
+        }
+    }
+    BlockPermutation(const BlockPermutation&) = delete;
+    BlockPermutation& operator=(const BlockPermutation&) = delete;
+
+    // dst[k] = src[gather[k]] в каждом целом блоке
+    void Gather(const uint8_t* src, uint8_t* dst, size_t length) const {
+        if (route.empty()) {
+            GatherDirect(src, dst, length, gather);
+            return;
+        }
+        uint8_t* buffer = Buffer();
+        for (size_t block = 0; block + blockSize <= length; block += blockSize) {
+            const uint8_t* in = src + block;
+            uint8_t* out = dst + block;
+            for (size_t j = 0; j < blockSize; ++j) {
+                buffer[route[j]] = in[j];
+            }
+            for (size_t k = 0; k < blockSize; ++k) {
+                out[k] = buffer[(k & ~SEGMENT_MASK) + local[k]];
+            }
+        }
+    }
+
+    // Обратная перестановка: dst[gather[k]] = src[k]
+    void Scatter(const uint8_t* src, uint8_t* dst, size_t length) const {
+        if (route.empty()) {
+            GatherDirect(src, dst, length, inverse);
+            return;
+        }
+        uint8_t* buffer = Buffer();
+        for (size_t block = 0; block + blockSize <= length; block += blockSize) {
+            const uint8_t* in = src + block;
+            uint8_t* out = dst + block;
+            for (size_t k = 0; k < blockSize; ++k) {
+                buffer[(k & ~SEGMENT_MASK) + local[k]] = in[k];
+            }
+            for (size_t j = 0; j < blockSize; ++j) {
+                out[j] = buffer[route[j]];
+            }
+        }
+    }
+
+    // Память вспомогательных таблиц двухпроходной перестановки
+    size_t TableBytes() const {
+        return route.size() * sizeof(uint32_t) + local.size() * sizeof(uint16_t);
+    }
+
+private:
+    const uint32_t* gather;
+    const uint32_t* inverse;
+    size_t blockSize;
+    std::vector<uint32_t> route; // позиция байта источника в буфере; пусто - один проход
+    std::vector<uint16_t> local; // позиция байта приёмника в части буфера его участка
+
+    static const size_t SEGMENT_MASK = (size_t(1) << PERMUTATION_SEGMENT_SHIFT) - 1;
+
+    void GatherDirect(const uint8_t* src, uint8_t* dst, size_t length, const uint32_t* table) const {
+        for (size_t block = 0; block + blockSize <= length; block += blockSize) {
+            for (size_t k = 0; k < blockSize; ++k) {
+                dst[block + k] = src[block + table[k]];
+            }
+        }
+    }
+
+    // Буфер блока для потока; растёт до наибольшего блока, который поток переставлял
+    uint8_t* Buffer() const {
+        thread_local std::vector<uint8_t> buffer;
+        if (buffer.size() < blockSize) {
+            buffer.resize(blockSize);
+        }
+        return buffer.data();
+    }
+
+    // Доля соседних элементов таблицы, попадающих в строку кэша, которой не было среди
+    // четырёх последних, больше 1/8
+    bool Scattered() const {
+        size_t lines[4] = {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX};
+        size_t misses = 0;
+        for (size_t k = 0; k < blockSize; ++k) {
+            size_t line = gather[k] >> 6;
+            if (line != lines[0] && line != lines[1] && line != lines[2] && line != lines[3]) {
+                lines[misses % 4] = line;
+                ++misses;
+            }
+        }
+        return misses * 8 > blockSize;
+    }
+};
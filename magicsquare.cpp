@@ -1,4 +1,12 @@
 #include "magicsquare.h"
+#include "blockio.h"
+#include "parallel.h"
+#include "uringio.h"
+#include "stats.h"
+#include "trace.h"
+#include "textblock.h"
+#include "gatherkernel.h"
+#include "tablecache.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -9,25 +17,89 @@
 #include <random>
 #include <ctime>
 #include <stdexcept>
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <utility>
 
 using namespace std;
 
-vector<vector<int>> GenerateMagicSquare(int n) {
-    vector<vector<int>> square(n, vector<int>(n, 0));
-
-    int x = 0, y = n / 2;
-    for (int num = 1; num <= n * n; num++) {
-        square[x][y] = num;
-        int nextX = (x + n - 1) % n;
-        int nextY = (y + 1) % n;
-        if (square[nextX][nextY] != 0) {
-            nextX = (x + 1) % n;
-            nextY = y;
+const int MAX_MAGIC_SQUARE_SIZE = 4096;
+
+// Нечётные квадраты до этого порядка переставляются ядрами с таблицами, вычисленными
+// при компиляции; таблицы чётных и больших строятся при первом обращении
+const int MAX_FIXED_MAGIC_SQUARE_SIZE = 9;
+
+// Квадрат нечётного порядка n сиамским методом в клетки квадрата со стороной stride, начиная
+// со строки rowOffset и столбца colOffset, числами first + 1, ..., first + n * n.
+// Очередное число ставится вверх-вправо от предыдущего, а после каждых n чисел, когда
+// эта клетка уже занята, - под предыдущим; занятость поэтому не проверяется
+template <typename Square>
+constexpr void FillSiameseSquare(Square& square, int n, int stride, int rowOffset, int colOffset, int first) {
+    int startX = 0, startY = n / 2;
+    for (int block = 0; block < n; block++) {
+        int x = startX, y = startY;
+        for (int step = 0; step < n; step++) {
+            square[(rowOffset + x) * stride + colOffset + y] = first + block * n + step + 1;
+            x = (x == 0) ? n - 1 : x - 1;
+            y = (y == n - 1) ? 0 : y + 1;
+        }
+        startX = (startX + 2) % n;
+        startY = (startY + n - 1) % n;
+    }
+}
+
+// Магический квадрат порядка n >= 3: square[i * n + j] - число в клетке.
+// Нечётный порядок - сиамский метод; порядок, кратный 4, - числа по строкам, у которых
+// клетки диагоналей каждого квадрата 4 * 4 заменены дополнением до n * n + 1;
+// порядок 4k + 2 - метод Стрейчи: четыре сиамских квадрата порядка 2k + 1 с обменом
+// k левых столбцов (в средней строке сдвинутых на один вправо) между левыми четвертями
+// и k - 1 правых между правыми
+template <typename Square>
+constexpr void FillMagicSquare(Square& square, int n) {
+    if (n % 2 == 1) {
+        FillSiameseSquare(square, n, n, 0, 0, 0);
+        return;
+    }
+    
+    if (n % 4 == 0) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                int cell = i * n + j;
+                bool diagonal = (i % 4 == j % 4) || (i % 4 + j % 4 == 3);
+                square[cell] = diagonal ? n * n - cell : cell + 1;
+            }
         }
-        x = nextX;
-        y = nextY;
+        return;
     }
     
+    int m = n / 2;
+    int k = (n - 2) / 4;
+    FillSiameseSquare(square, m, n, 0, 0, 0);
+    FillSiameseSquare(square, m, n, m, m, m * m);
+    FillSiameseSquare(square, m, n, 0, m, 2 * m * m);
+    FillSiameseSquare(square, m, n, m, 0, 3 * m * m);
+    
+    auto swapCells = [&](int row, int col) {
+        auto top = square[row * n + col];
+        square[row * n + col] = square[(row + m) * n + col];
+        square[(row + m) * n + col] = top;
+    };
+    for (int i = 0; i < m; i++) {
+        int shift = (i == m / 2) ? 1 : 0;
+        for (int j = 0; j < k; j++) {
+            swapCells(i, j + shift);
+        }
+        for (int j = n - k + 1; j < n; j++) {
+            swapCells(i, j);
+        }
+    }
+}
+
+template <int N>
+constexpr array<int, N * N> GenerateMagicSquare() {
+    array<int, N * N> square = {};
+    FillMagicSquare(square, N);
     return square;
 }
 
@@ -37,8 +109,8 @@ int ParseSize(const string& key) {
         if (size < 3) {
             throw invalid_argument("Размер квадрата должен быть не менее 3");
         }
-        if (size > 10 || size % 2 == 0) {
-            throw invalid_argument("Размер квадрата должен быть нечётным числом от 3 до 9");
+        if (size > MAX_MAGIC_SQUARE_SIZE) {
+            throw invalid_argument("Размер квадрата не должен превышать " + to_string(MAX_MAGIC_SQUARE_SIZE));
         }
         return size;
     } catch (const exception& e) {
@@ -54,234 +126,314 @@ string GenerateMagicSquareKey() {
     return to_string(size);
 }
 
-vector<string> SplitUTF8(const string& str) {
-    vector<string> characters;
-    
-    for (size_t i = 0; i < str.length();) {
-        unsigned char c = str[i];
-        size_t charLen = 1;
-        
-        if ((c & 0x80) == 0) {
-            charLen = 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            charLen = 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            charLen = 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            charLen = 4;
-        }
-        
-        characters.push_back(str.substr(i, charLen));
-        i += charLen;
+// Плоские таблицы выборки для блока N * N: при шифровании байт с номером k
+// попадает в клетку квадрата, где записано число k + 1; decrypt - обратная таблица.
+// Вычисляются при компиляции
+template <int N>
+struct MagicSquareTableData {
+    array<uint16_t, N * N> encrypt;
+    array<uint16_t, N * N> decrypt;
+    array<uint8_t, N * N> encryptBytes;
+    array<uint8_t, N * N> decryptBytes;
+};
+
+template <int N>
+constexpr MagicSquareTableData<N> BuildMagicSquareTables() {
+    MagicSquareTableData<N> tables = {};
+    array<int, N * N> square = GenerateMagicSquare<N>();
+    for (size_t cell = 0; cell < square.size(); cell++) {
+        int k = square[cell] - 1;
+        tables.encrypt[cell] = static_cast<uint16_t>(k);
+        tables.decrypt[k] = static_cast<uint16_t>(cell);
     }
-    
-    return characters;
+    tables.encryptBytes = ByteTable(tables.encrypt);
+    tables.decryptBytes = ByteTable(tables.decrypt);
+    return tables;
 }
 
-vector<uint8_t> MagicSquareEncryptBinary(const vector<uint8_t>& data, int size) {
-    int squareSize = size * size;
-    
-    vector<uint8_t> paddedData = data;
-    
-    if (paddedData.size() < squareSize) {
-        paddedData.resize(squareSize, 0);
-    } else if (paddedData.size() % squareSize != 0) {
-        size_t padding = squareSize - (paddedData.size() % squareSize);
-        paddedData.resize(paddedData.size() + padding, 0);
+template <int N>
+constexpr MagicSquareTableData<N> magicSquareTables = BuildMagicSquareTables<N>();
+
+// Ядра для квадрата порядка N с таблицами, подставленными при компиляции;
+// квадраты порядка 3, 5 и 7 помещаются в векторный регистр
+template <int N>
+struct MagicSquareKernel {
+    static void Encrypt(const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherFixedVector<N * N>(src, dst, length, magicSquareTables<N>.encrypt.data(), magicSquareTables<N>.encryptBytes.data());
     }
-    
-    auto magicSquare = GenerateMagicSquare(size);
-    vector<uint8_t> result(paddedData.size());
-    
-    vector<pair<int, int>> positions(squareSize);
-    for (size_t i = 0; i < size; i++) {
-        for (size_t j = 0; j < size; j++) {
-            positions[magicSquare[i][j] - 1] = {i, j};
-        }
+    static void Decrypt(const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherFixedVector<N * N>(src, dst, length, magicSquareTables<N>.decrypt.data(), magicSquareTables<N>.decryptBytes.data());
     }
-    
-    for (int block = 0; block < paddedData.size(); block += squareSize) {
-        vector<vector<uint8_t>> tempMatrix(size, vector<uint8_t>(size, 0));
-        
-        for (size_t k = 0; k < squareSize; k++) {
-            auto [i, j] = positions[k];
-            tempMatrix[i][j] = paddedData[block + k];
-        }
-        
-        for (int i = 0; i < size; i++) {
-            for (int j = 0; j < size; j++) {
-                result[block + i * size + j] = tempMatrix[i][j];
-            }
-        }
+};
+
+// Ядра для нечётных порядков 3, 5, ..., MAX_FIXED_MAGIC_SQUARE_SIZE: порядок size - элемент (size - 3) / 2
+constexpr auto magicSquareKernels =
+    MakeGatherKernels<MagicSquareKernel, 3, 2>(make_index_sequence<(MAX_FIXED_MAGIC_SQUARE_SIZE - 1) / 2>());
+
+// Таблицы и преобразования блоков одного порядка; таблицы в виде векторов нужны выборке
+// символов текста и каскаду шифров
+struct MagicSquareTables {
+    vector<uint32_t> encrypt;
+    vector<uint32_t> decrypt;
+    vector<uint8_t> encryptBytes; // для векторного ядра, если блок не больше MAX_VECTOR_GATHER_BLOCK
+    vector<uint8_t> decryptBytes;
+    unique_ptr<BlockPermutation> permutation; // у порядков, построенных во время выполнения
+    BlockTransform encryptBlocks;
+    BlockTransform decryptBlocks;
+    
+    size_t TableBytes() const {
+        return (encrypt.size() + decrypt.size()) * sizeof(uint32_t) + encryptBytes.size() + decryptBytes.size() +
+               (permutation ? permutation->TableBytes() : 0);
     }
-    
-    return result;
+};
+
+template <int N>
+shared_ptr<const MagicSquareTables> MakeMagicSquareTables() {
+    const auto& data = magicSquareTables<N>;
+    const GatherKernels& kernels = magicSquareKernels[(N - 3) / 2];
+    auto tables = make_shared<MagicSquareTables>();
+    tables->encrypt.assign(data.encrypt.begin(), data.encrypt.end());
+    tables->decrypt.assign(data.decrypt.begin(), data.decrypt.end());
+    tables->encryptBlocks = kernels.encrypt;
+    tables->decryptBlocks = kernels.decrypt;
+    return tables;
 }
 
-vector<uint8_t> MagicSquareDecryptBinary(const vector<uint8_t>& encryptedData, int size) {
-    int squareSize = size * size;
-    vector<uint8_t> result(encryptedData.size());
-    
-    auto magicSquare = GenerateMagicSquare(size);
-    
-    vector<pair<int, int>> positions(squareSize);
-    for (size_t i = 0; i < size; i++) {
-        for (size_t j = 0; j < size; j++) {
-            positions[magicSquare[i][j] - 1] = {i, j};
-        }
+template <size_t... Offsets>
+vector<shared_ptr<const MagicSquareTables>> MakeAllMagicSquareTables(index_sequence<Offsets...>) {
+    return {MakeMagicSquareTables<3 + 2 * static_cast<int>(Offsets)>()...};
+}
+
+// Чётный порядок или нечётный больше MAX_FIXED_MAGIC_SQUARE_SIZE: таблицы строятся при первом
+// обращении, блоки переставляет BlockPermutation; квадраты до 8 * 8 - векторное ядро
+shared_ptr<const MagicSquareTables> BuildMagicSquareTables(int size) {
+    size_t cells = static_cast<size_t>(size) * size;
+    TraceSpan span("table_build", cells);
+    auto tables = make_shared<MagicSquareTables>();
+    vector<int> square(cells);
+    FillMagicSquare(square, size);
+    tables->encrypt.resize(cells);
+    tables->decrypt.resize(cells);
+    for (size_t cell = 0; cell < cells; cell++) {
+        uint32_t k = static_cast<uint32_t>(square[cell] - 1);
+        tables->encrypt[cell] = k;
+        tables->decrypt[k] = static_cast<uint32_t>(cell);
     }
-    
-    for (int block = 0; block < encryptedData.size(); block += squareSize) {
-        vector<vector<uint8_t>> tempMatrix(size, vector<uint8_t>(size, 0));
-        
-        for (size_t i = 0; i < size; i++) {
-            for (size_t j = 0; j < size; j++) {
-                tempMatrix[i][j] = encryptedData[block + i * size + j];
-            }
-        }
-        
-        for (int k = 0; k < squareSize; k++) {
-            auto [i, j] = positions[k];
-            result[block + k] = tempMatrix[i][j];
-        }
+    if (cells <= MAX_VECTOR_GATHER_BLOCK) {
+        tables->encryptBytes.assign(tables->encrypt.begin(), tables->encrypt.end());
+        tables->decryptBytes.assign(tables->decrypt.begin(), tables->decrypt.end());
     }
     
-    while (!result.empty() && result.back() == 0) {
-        result.pop_back();
+    tables->permutation = make_unique<BlockPermutation>(tables->encrypt, tables->decrypt);
+    const MagicSquareTables* data = tables.get();
+    tables->encryptBlocks = [data, cells](const uint8_t* src, uint8_t* dst, size_t length) {
+        size_t done = data->encryptBytes.empty() ? 0 : GatherBlocksVector(src, dst, length, data->encryptBytes.data(), cells);
+        data->permutation->Gather(src + done, dst + done, length - done);
+    };
+    tables->decryptBlocks = [data, cells](const uint8_t* src, uint8_t* dst, size_t length) {
+        size_t done = data->decryptBytes.empty() ? 0 : GatherBlocksVector(src, dst, length, data->decryptBytes.data(), cells);
+        data->permutation->Scatter(src + done, dst + done, length - done);
+    };
+    return tables;
+}
+
+shared_ptr<const MagicSquareTables> GetMagicSquareTables(int size) {
+    if (size <= MAX_FIXED_MAGIC_SQUARE_SIZE && size % 2 == 1) {
+        // Сами таблицы вычислены при компиляции; при первом обращении они копируются в векторы
+        static const vector<shared_ptr<const MagicSquareTables>> tables = [] {
+            TraceSpan span("table_build");
+            return MakeAllMagicSquareTables(make_index_sequence<(MAX_FIXED_MAGIC_SQUARE_SIZE - 1) / 2>());
+        }();
+        return tables[(size - 3) / 2];
     }
     
-    return result;
+    static TableCache<MagicSquareTables> cache;
+    return cache.Get(size, [size] {
+        return BuildMagicSquareTables(size);
+    });
 }
 
-string MagicSquareTextEncrypt(const string& text, const string& key) {
-    int size = ParseSize(key);
-    
-    vector<string> characters = SplitUTF8(text);
-    string result;
-    
-    int squareSize = size * size;
-    
-    for (size_t i = 0; i < characters.size(); i += squareSize) {
-        int currentBlockSize = min(static_cast<size_t>(squareSize), characters.size() - i);
-        
-        vector<string> block;
-        for (size_t j = 0; j < currentBlockSize; ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        while (block.size() < static_cast<size_t>(squareSize)) {
-            block.push_back(" ");
-        }
-        
-        auto magicSquare = GenerateMagicSquare(size);
-        
-        vector<pair<int, int>> positions(squareSize);
-        for (size_t i = 0; i < size; i++) {
-            for (size_t j = 0; j < size; j++) {
-                positions[magicSquare[i][j] - 1] = {i, j};
-            }
-        }
-        
-        vector<vector<string>> tempMatrix(size, vector<string>(size, " "));
-        for (size_t k = 0; k < squareSize; k++) {
-            auto [row, col] = positions[k];
-            tempMatrix[row][col] = block[k];
-        }
-        
-        for (size_t row = 0; row < size; row++) {
-            for (size_t col = 0; col < size; col++) {
-                result += tempMatrix[row][col];
-            }
-        }
+BlockCipher MakeMagicSquareCipher(int size) {
+    shared_ptr<const MagicSquareTables> tables = GetMagicSquareTables(size);
+    
+    BlockCipher cipher;
+    cipher.blockSize = static_cast<size_t>(size) * size;
+    cipher.encrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        tables->encryptBlocks(src, dst, length);
+    };
+    cipher.decrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        tables->decryptBlocks(src, dst, length);
+    };
+    cipher.padEmpty = true;
+    cipher.cipherId = CipherId::MAGIC_SQUARE;
+    cipher.keyParam = static_cast<uint32_t>(size);
+    return cipher;
+}
+
+void MagicSquareSetChunkSize(size_t bytes) {
+    SetStreamChunkSize(bytes);
+}
+
+void MagicSquareSetIoBackend(const string& name) {
+    SetIoBackend(name);
+}
+
+void MagicSquareSetThreadCount(unsigned count) {
+    SetThreadCount(count);
+}
+
+AsyncIoStats MagicSquareGetAsyncIoStats() {
+    return GetAsyncIoStats();
+}
+
+CipherStats MagicSquareGetStats() {
+    return GetCipherStats();
+}
+
+void MagicSquareResetStats() {
+    ResetCipherStats();
+}
+
+void MagicSquareSetStatsEnabled(bool enabled) {
+    SetStatsEnabled(enabled);
+}
+
+// Разобранный ключ и таблицы квадрата для него
+struct MagicSquareContext {
+    int size;
+    shared_ptr<const MagicSquareTables> tables;
+    BlockCipher cipher; // файловое преобразование ключа: им же переставляются данные в памяти
+};
+
+MagicSquareContext* MagicSquareCreateContext(const string& key) {
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    auto context = make_unique<MagicSquareContext>();
+    context->size = ParseSize(key);
+    context->tables = GetMagicSquareTables(context->size);
+    context->cipher = MakeMagicSquareCipher(context->size);
+    return context.release();
+}
+
+void MagicSquareDestroyContext(MagicSquareContext* context) {
+    delete context;
+}
+
+// Текст из одних ASCII-символов переставляется тем же байтовым ядром, что и файлы
+string GatherAsciiText(const string& text, size_t blockSize, const BlockTransform& transform, bool trimSpaces) {
+    return TransformAsciiText(text, blockSize, trimSpaces, [&](const char* src, char* dst, size_t length) {
+        ParallelTransform(reinterpret_cast<const uint8_t*>(src), reinterpret_cast<uint8_t*>(dst), length, blockSize, transform);
+    });
+}
+
+string TransformText(const string& text, const MagicSquareTables& tables, bool encrypt) {
+    const vector<uint32_t>& table = encrypt ? tables.encrypt : tables.decrypt;
+    if (IsAscii(text.data(), text.size())) {
+        return GatherAsciiText(text, table.size(), encrypt ? tables.encryptBlocks : tables.decryptBlocks, !encrypt);
     }
-    
-    return result;
+    return GatherText(text, table, !encrypt);
+}
+
+string MagicSquareEncryptWithContext(const MagicSquareContext* context, const string& text) {
+    CountStat(Stat::CALLS);
+    return TransformText(text, *context->tables, true);
+}
+
+string MagicSquareDecryptWithContext(const MagicSquareContext* context, const string& encryptedText) {
+    CountStat(Stat::CALLS);
+    return TransformText(encryptedText, *context->tables, false);
+}
+
+string MagicSquareTextEncrypt(const string& text, const string& key) {
+    unique_ptr<MagicSquareContext> context(MagicSquareCreateContext(key));
+    return MagicSquareEncryptWithContext(context.get(), text);
 }
 
 string MagicSquareTextDecrypt(const string& encryptedText, const string& key) {
-    int size = ParseSize(key);
-    
-    vector<string> characters = SplitUTF8(encryptedText);
-    string result;
-    
-    int squareSize = size * size;
-    
-    auto magicSquare = GenerateMagicSquare(size);
-    
-    vector<pair<int, int>> positions(squareSize);
-    for (size_t i = 0; i < size; i++) {
-        for (size_t j = 0; j < size; j++) {
-            positions[magicSquare[i][j] - 1] = {i, j};
-        }
-    }
-    
-    for (size_t i = 0; i < characters.size(); i += squareSize) {
-        vector<string> block;
-        for (size_t j = 0; j < static_cast<size_t>(squareSize) && (i + j) < characters.size(); ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        vector<vector<string>> tempMatrix(size, vector<string>(size, " "));
-        for (int row = 0; row < size; row++) {
-            for (int col = 0; col < size; col++) {
-                size_t index = i + row * size + col;
-                if (index < characters.size()) {
-                    tempMatrix[row][col] = characters[index];
-                }
-            }
-        }
-        
-        for (int k = 0; k < squareSize; k++) {
-            auto [row, col] = positions[k];
-            result += tempMatrix[row][col];
-        }
-    }
-    
-    while (!result.empty() && result.back() == ' ') {
-        result.pop_back();
-    }
-    
-    return result;
+    unique_ptr<MagicSquareContext> context(MagicSquareCreateContext(key));
+    return MagicSquareDecryptWithContext(context.get(), encryptedText);
+}
+
+// Шифр для ключа файловой операции: учитывается вызов и время разбора ключа
+BlockCipher MagicSquareCipherForKey(const string& key) {
+    CountStat(Stat::CALLS);
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    return MakeMagicSquareCipher(ParseSize(key));
 }
 
 void MagicSquareFileEncrypt(const string& inPath, const string& outPath, const string& key) {
-    int size = ParseSize(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto encrypted = MagicSquareEncryptBinary(content, size);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
-    }
-    outputFile.write(reinterpret_cast<const char*>(encrypted.data()), encrypted.size());
-    outputFile.close();
+    EncryptFile(inPath, outPath, MagicSquareCipherForKey(key));
+}
+
+void MagicSquareFileEncryptFramed(const string& inPath, const string& outPath, const string& key) {
+    StreamEncryptFileFramed(inPath, outPath, MagicSquareCipherForKey(key));
 }
 
 void MagicSquareFileDecrypt(const string& inPath, const string& outPath, const string& key) {
+    DecryptFile(inPath, outPath, MagicSquareCipherForKey(key));
+}
+
+void MagicSquareStreamEncrypt(int inFd, int outFd, const string& key) {
+    StreamEncryptDescriptor(inFd, outFd, MagicSquareCipherForKey(key));
+}
+
+void MagicSquareStreamDecrypt(int inFd, int outFd, const string& key) {
+    StreamDecryptDescriptor(inFd, outFd, MagicSquareCipherForKey(key));
+}
+
+size_t MagicSquareDecryptRange(const string& inPath, const string& key, uint64_t offset, uint64_t length, uint8_t* out) {
+    return DecryptFileRange(inPath, MagicSquareCipherForKey(key), offset, length, out);
+}
+
+size_t MagicSquareEncryptInPlace(const MagicSquareContext* context, uint8_t* buffer, size_t length, size_t capacity) {
+    CountStat(Stat::CALLS);
+    return EncryptBuffer(buffer, length, capacity, context->cipher);
+}
+
+size_t MagicSquareDecryptInPlace(const MagicSquareContext* context, uint8_t* buffer, size_t length) {
+    CountStat(Stat::CALLS);
+    return DecryptBuffer(buffer, length, context->cipher);
+}
+
+size_t MagicSquareBufferBound(const MagicSquareContext* context, size_t length) {
+    return EncryptedBufferSize(length, context->cipher);
+}
+
+vector<uint32_t> MagicSquareEncryptTable(const string& key) {
+    return GetMagicSquareTables(ParseSize(key))->encrypt;
+}
+
+size_t MagicSquareTextEncryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                   char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<MagicSquareContext> context(MagicSquareCreateContext(key));
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, false, [&](size_t) -> const vector<uint32_t>& {
+        return context->tables->encrypt;
+    });
+}
+
+size_t MagicSquareTextDecryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                   char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<MagicSquareContext> context(MagicSquareCreateContext(key));
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, true, [&](size_t) -> const vector<uint32_t>& {
+        return context->tables->decrypt;
+    });
+}
+
+size_t MagicSquareTextBatchBound(const string& key, const size_t* lengths, size_t count) {
     int size = ParseSize(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto decrypted = MagicSquareDecryptBinary(content, size);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
-    }
-    outputFile.write(reinterpret_cast<const char*>(decrypted.data()), decrypted.size());
-    outputFile.close();
+    return GatherTextBatchBound(lengths, count, static_cast<size_t>(size) * size);
+}
+
+const CipherPlugin* CipherPluginDescriptor() {
+    static const CipherPlugin plugin = {
+        CIPHER_PLUGIN_VERSION, 3, "magicsquare", "Магический квадрат", "ШИФРОВАНИЕ МАГИЧЕСКИМ КВАДРАТОМ", "магического квадрата",
+        MagicSquareTextEncrypt, MagicSquareTextDecrypt,
+        MagicSquareFileEncrypt, MagicSquareFileDecrypt, MagicSquareFileEncryptFramed, MagicSquareDecryptRange,
+        MagicSquareStreamEncrypt, MagicSquareStreamDecrypt,
+        GenerateMagicSquareKey, MagicSquareSetChunkSize, MagicSquareSetIoBackend, MagicSquareSetThreadCount,
+        MagicSquareGetAsyncIoStats, MagicSquareGetStats, MagicSquareResetStats, MagicSquareSetStatsEnabled,
+        MagicSquareEncryptTable
+    };
+    return &plugin;
 }
@@ -1,12 +1,68 @@
 #pragma once
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "plugin.h"
 
 #define MAGICSQUARE_API
 
+// Разобранный ключ с готовыми таблицами прямого и обратного преобразования
+struct MagicSquareContext;
+
 extern "C" {
     MAGICSQUARE_API std::string MagicSquareTextEncrypt(const std::string& text, const std::string& key);
     MAGICSQUARE_API std::string MagicSquareTextDecrypt(const std::string& text, const std::string& key);
+    // Контекст создаётся один раз на ключ и используется для любого числа сообщений
+    MAGICSQUARE_API MagicSquareContext* MagicSquareCreateContext(const std::string& key);
+    MAGICSQUARE_API std::string MagicSquareEncryptWithContext(const MagicSquareContext* context, const std::string& text);
+    MAGICSQUARE_API std::string MagicSquareDecryptWithContext(const MagicSquareContext* context, const std::string& text);
+    MAGICSQUARE_API void MagicSquareDestroyContext(MagicSquareContext* context);
+    // Пакетная обработка count сообщений одним ключом: результат сообщения i записывается
+    // в out[offsets[i], offsets[i + 1]), в offsets count + 1 элементов. Возвращает общий размер;
+    // достаточный размер out даёт TextBatchBound, при нехватке бросается length_error
+    MAGICSQUARE_API size_t MagicSquareTextEncryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    MAGICSQUARE_API size_t MagicSquareTextDecryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    MAGICSQUARE_API size_t MagicSquareTextBatchBound(const std::string& key, const size_t* lengths, size_t count);
     MAGICSQUARE_API void MagicSquareFileEncrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Шифрование в контейнер с заголовком, хранящим исходную длину; FileDecrypt распознаёт его сам
+    MAGICSQUARE_API void MagicSquareFileEncryptFramed(const std::string& inPath, const std::string& outPath, const std::string& key);
     MAGICSQUARE_API void MagicSquareFileDecrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Потоковая обработка открытых дескрипторов (каналов, stdin/stdout); дескрипторы не закрываются
+    MAGICSQUARE_API void MagicSquareStreamEncrypt(int inFd, int outFd, const std::string& key);
+    MAGICSQUARE_API void MagicSquareStreamDecrypt(int inFd, int outFd, const std::string& key);
+    // Расшифрование байт [offset, offset + length) исходного файла с чтением только нужных блоков;
+    // возвращает количество записанных в out байт
+    MAGICSQUARE_API size_t MagicSquareDecryptRange(const std::string& inPath, const std::string& key, uint64_t offset, uint64_t length, uint8_t* out);
+    // Шифрование данных в памяти на месте, без выделения памяти: buffer[0, length) дополняется
+    // нулями до целого блока и переставляется внутри buffer. Вызывающий может сразу выделить
+    // MagicSquareBufferBound байт; при меньшем capacity бросается length_error. Возвращает длину результата
+    MAGICSQUARE_API size_t MagicSquareEncryptInPlace(const MagicSquareContext* context, uint8_t* buffer, size_t length, size_t capacity);
+    // Расшифрование на месте; length кратна размеру блока. Возвращает длину данных без нулей
+    // в конце, как при расшифровании файла без заголовка
+    MAGICSQUARE_API size_t MagicSquareDecryptInPlace(const MagicSquareContext* context, uint8_t* buffer, size_t length);
+    // Размер буфера для шифрования length байт на месте
+    MAGICSQUARE_API size_t MagicSquareBufferBound(const MagicSquareContext* context, size_t length);
     MAGICSQUARE_API std::string GenerateMagicSquareKey();
+    // Размер порции потоковой обработки файлов (по умолчанию 4 МБ); 0 - обработка файла целиком
+    MAGICSQUARE_API void MagicSquareSetChunkSize(size_t bytes);
+    // Механизм файлового ввода-вывода: "stream" (по умолчанию), "whole", "mmap", "mmap-huge",
+    // "uring" или "uring:N" - асинхронный ввод-вывод с глубиной очереди N
+    MAGICSQUARE_API void MagicSquareSetIoBackend(const std::string& name);
+    // Количество потоков поблочной обработки (по умолчанию 1); 0 - по числу ядер
+    MAGICSQUARE_API void MagicSquareSetThreadCount(unsigned count);
+    // Статистика очереди механизма "uring" для последней файловой операции этого потока
+    MAGICSQUARE_API AsyncIoStats MagicSquareGetAsyncIoStats();
+    // Счётчики вызовов, объёмов и времени по фазам, сумма по всем потокам; сбор включается
+    // SetStatsEnabled или переменной окружения CRYPTOGRAPHY_STATS
+    MAGICSQUARE_API CipherStats MagicSquareGetStats();
+    MAGICSQUARE_API void MagicSquareResetStats();
+    MAGICSQUARE_API void MagicSquareSetStatsEnabled(bool enabled);
+    // Таблица выборки файлового шифрования одного блока для ключа: байт k зашифрованного
+    // блока берётся из позиции table[k]; по ней каскад шифров составляет общую перестановку
+    MAGICSQUARE_API std::vector<uint32_t> MagicSquareEncryptTable(const std::string& key);
+    // Описание шифра для реестра библиотек программы
+    MAGICSQUARE_API const CipherPlugin* CipherPluginDescriptor();
 }
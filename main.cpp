@@ -8,28 +8,12 @@
 #include <sstream>
 #include <vector>
 #include <stdexcept>
-#include <dlfcn.h>
+#include "registry.h"
+#include "cli.h"
+#include "trace.h"
 
 using namespace std;
 
-enum class Menu {
-    PERMUTATION = 1,
-    MATRIX,
-    MAGIC_SQUARE,
-    KEY_GENERATOR,
-    EXIT = 5
-};
-
-// Объявления указателей на функции
-using PermutationText = string (*)(const string&, const string&);
-using PermutationFile = void (*)(const string&, const string&, const string&);
-using MagicSquareText = string (*)(const string&, const string&);
-using MagicSquareFile = void (*)(const string&, const string&, const string&);
-using MatrixText = string (*)(const string&, const string&);
-using MatrixFile = void (*)(const string&, const string&, const string&);
-using GenerateKeyFunc = string (*)();
-using TextFunc = string (*)(const string&, const string&);
-
 uint64_t MenuChoice(uint64_t min, uint64_t max) {
     uint64_t choice;
     while (true) {
@@ -57,7 +41,7 @@ bool Authentication() {
     while (attempts > 0) {
         cout << "\nВведите пароль доступа: ";
         cin >> password;
-        if (password == "123") {
+        if (CheckPassword(password)) {
             successfulAuth = true;
             break;
         } else {
@@ -97,61 +81,10 @@ void SaveKeyFile(const string& cipherName, const string& key) {
     }
 }
 
-string GenerateKeyCipher(const string& cipherName) {
-    void* handle = nullptr;
-    GenerateKeyFunc pKey = nullptr;
-
-    string libPath;
-    string cipherDisplayName;
-    
-    string libExtension = ".so";
-    
-    if (cipherName == "permutation") {
-        libPath = "./build/lib/libpermutation" + libExtension;
-        cipherDisplayName = "Перестановка";
-    } else if (cipherName == "magicsquare") {
-        libPath = "./build/lib/libmagicsquare" + libExtension;
-        cipherDisplayName = "Магический квадрат";
-    } else if (cipherName == "matrix") {
-        libPath = "./build/lib/libmatrix" + libExtension;
-        cipherDisplayName = "Матричная шифровка";
-    } else {
-        cerr << "ОШИБКА: Неизвестный тип шифра: " << cipherName << endl;
-        return "";
-    }
-
-    handle = dlopen(libPath.c_str(), RTLD_LAZY);
-
-    if (!handle) {
-        cerr << "ОШИБКА! Не удалось загрузить библиотеку: " << libPath << endl;
-        return "";
-    }
-
-    // Получаем указатель на функцию
-    string funcName;
-    if (cipherName == "permutation") {
-        funcName = "GeneratePermutationKey";
-    } else if (cipherName == "magicsquare") {
-        funcName = "GenerateMagicSquareKey";
-    } else if (cipherName == "matrix") {
-        funcName = "GenerateMatrixKey";
-    }
-
-    pKey = (GenerateKeyFunc)dlsym(handle, funcName.c_str());
-
-    string generatedKey;
-    if (pKey) {
-        generatedKey = pKey();
-        cout << "Сгенерированный ключ: " << generatedKey << endl;
-        SaveKeyFile(cipherDisplayName, generatedKey);
-    } else {
-        cerr << "ОШИБКА! Не удалось найти функцию: " << funcName << endl;
-    }
-
-    if (handle) {
-        dlclose(handle);
-    }
-
+string GenerateKeyCipher(const CipherPlugin& cipher) {
+    string generatedKey = cipher.generateKey();
+    cout << "Сгенерированный ключ: " << generatedKey << endl;
+    SaveKeyFile(cipher.displayName, generatedKey);
     return generatedKey;
 }
 
@@ -191,88 +124,67 @@ void SaveToFile(const string& content, const string& operationType) {
     }
 }
 
-void KeyGeneratorMenu() {
+void KeyGeneratorMenu(const CipherRegistry& registry) {
+    const auto& ciphers = registry.Ciphers();
+    
     cout << "\nГЕНЕРАТОР КЛЮЧЕЙ\n";
     cout << "Выберите тип шифра для генерации ключа:\n";
-    cout << "1. Перестановка\n";
-    cout << "2. Матричная шифровка\n";
-    cout << "3. Магический квадрат\n";
-    cout << "4. Назад в главное меню\n";
+    for (size_t i = 0; i < ciphers.size(); ++i) {
+        cout << i + 1 << ". " << ciphers[i].plugin->displayName << "\n";
+    }
+    cout << ciphers.size() + 1 << ". Назад в главное меню\n";
 
-    uint64_t choice = MenuChoice(1, 4);
-    
-    string cipherName;
-    
-    switch (static_cast<Menu>(choice)) {
-        case Menu::PERMUTATION: cipherName = "permutation";break;
-        case Menu::MATRIX: cipherName = "matrix"; break;
-        case Menu::MAGIC_SQUARE: cipherName = "magicsquare"; break;
-        case Menu::EXIT: return;
-        default: return;
+    uint64_t choice = MenuChoice(1, ciphers.size() + 1);
+    if (choice > ciphers.size()) {
+        return;
     }
     
-    string key = GenerateKeyCipher(cipherName);
+    string key = GenerateKeyCipher(*ciphers[choice - 1].plugin);
     if (!key.empty()) {
         cout << "Ключ успешно сгенерирован!\n";
     }
 }
 
-void ProcessTextFile(const string& inPath, const string& outPath, const string& key, bool encrypt, const string& cipherType, void* handle, TextFunc pEncrypt, TextFunc pDecrypt) {
+void ProcessTextFile(const string& inPath, const string& outPath, const string& key, bool encrypt, const CipherPlugin& cipher) {
     ifstream inputFile(inPath);
     if (!inputFile) {
         throw runtime_error("Не удалось открыть входной файл: " + inPath);
     }
     
-    string content((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
+    string content;
+    {
+        TraceSpan span("read");
+        content.assign(istreambuf_iterator<char>(inputFile), istreambuf_iterator<char>());
+        span.SetBytes(content.size());
+    }
     inputFile.close();
     
     string result;
-    if (encrypt) {
-        result = pEncrypt(content, key);
-        cout << "Текстовый файл зашифрован.\n";
-    } else {
-        result = pDecrypt(content, key);
-        cout << "Текстовый файл расшифрован.\n";
+    {
+        TraceSpan span("transform", content.size());
+        result = encrypt ? cipher.textEncrypt(content, key) : cipher.textDecrypt(content, key);
     }
+    cout << (encrypt ? "Текстовый файл зашифрован.\n" : "Текстовый файл расшифрован.\n");
     
     ofstream outputFile(outPath);
     if (!outputFile) {
         throw runtime_error("Не удалось создать выходной файл: " + outPath);
     }
-    outputFile << result;
-    outputFile.close();
+    {
+        TraceSpan span("write", result.size());
+        outputFile << result;
+        outputFile.close();
+    }
     
     if (DisplayResult()) {
         cout << "Содержимое файла:\n" << result << endl;
     }
 }
 
-void MatrixMenu() {
-    void* handle = nullptr;
-    MatrixText pEncryptText = nullptr, pDecryptText = nullptr;
-    MatrixFile pEncryptFile = nullptr, pDecryptFile = nullptr;
-
-    handle = dlopen("./build/lib/libmatrix.so", RTLD_LAZY);
-
-    if (!handle) {
-        cerr << "ОШИБКА! Не удалось загрузить библиотеку matrix.\n";
-        return;
-    }
-
-    pEncryptText = (MatrixText)dlsym(handle, "MatrixTextEncrypt");
-    pDecryptText = (MatrixText)dlsym(handle, "MatrixTextDecrypt");
-    pEncryptFile = (MatrixFile)dlsym(handle, "MatrixFileEncrypt");
-    pDecryptFile = (MatrixFile)dlsym(handle, "MatrixFileDecrypt");
-
-    if (!pEncryptText || !pDecryptText || !pEncryptFile || !pDecryptFile) {
-        cerr << "ОШИБКА! Не удалось найти одну или несколько функций в библиотеке matrix.\n";
-        dlclose(handle);
-        return;
-    }
-
+void CipherMenu(const CipherPlugin& cipher) {
     string text, result, inPath, outPath, key;
 
-    cout << "\nМАТРИЧНАЯ ШИФРОВКА\n";
+    cout << "\n" << cipher.menuTitle << "\n";
     cout << "1. Зашифровать текст.\n";
     cout << "2. Расшифровать текст.\n";
     cout << "3. Зашифровать бинарный файл.\n";
@@ -288,19 +200,18 @@ void MatrixMenu() {
         cout << "Введите текст для его обработки: ";
         getline(cin, text);
         
-        key = GetKeyUser("матричной шифровки");
+        key = GetKeyUser(cipher.keyPrompt);
         if (key.empty()) {
-            dlclose(handle);
             return;
         }
         
         try {
             if (choice == 1) {
-                result = pEncryptText(text, key);
+                result = cipher.textEncrypt(text, key);
                 cout << "Зашифрованный текст: " << result << endl;
                 SaveToFile(result, "зашифрованного текста");
             } else {
-                result = pDecryptText(text, key);
+                result = cipher.textDecrypt(text, key);
                 cout << "Расшифрованный текст: " << result << endl;
                 SaveToFile(result, "расшифрованного текста");
             }
@@ -314,18 +225,17 @@ void MatrixMenu() {
         cout << "Введите путь к файлу, в который необходимо записать результат: ";
         getline(cin, outPath);
         
-        key = GetKeyUser("матричной шифровки");
+        key = GetKeyUser(cipher.keyPrompt);
         if (key.empty()) {
-            dlclose(handle);
             return;
         }
         
         try {
             if (choice == 3) {
-                pEncryptFile(inPath, outPath, key);
+                cipher.fileEncrypt(inPath, outPath, key);
                 cout << "Бинарный файл зашифрован.\n";
             } else {
-                pDecryptFile(inPath, outPath, key);
+                cipher.fileDecrypt(inPath, outPath, key);
                 cout << "Бинарный файл расшифрован.\n";
             }
             
@@ -347,280 +257,65 @@ void MatrixMenu() {
         cout << "Введите путь к файлу, в который необходимо записать результат: ";
         getline(cin, outPath);
         
-        key = GetKeyUser("матричной шифровки");
+        key = GetKeyUser(cipher.keyPrompt);
         if (key.empty()) {
-            dlclose(handle);
             return;
         }
         
         try {
-            ProcessTextFile(inPath, outPath, key, (choice == 5), "матричной шифровки", handle, pEncryptText, pDecryptText);
+            ProcessTextFile(inPath, outPath, key, (choice == 5), cipher);
         } catch (const exception& e) {
             cerr << "ОШИБКА! " << e.what() << endl;
         }
     }
-
-    dlclose(handle);
 }
 
-void MagicSquareMenu() {
-    void* handle = nullptr;
-    MagicSquareText pEncryptText = nullptr, pDecryptText = nullptr;
-    MagicSquareFile pEncryptFile = nullptr, pDecryptFile = nullptr;
-
-    handle = dlopen("./build/lib/libmagicsquare.so", RTLD_LAZY);
-
-    if (!handle) {
-        cerr << "ОШИБКА! Не удалось загрузить библиотеку magicsquare.\n";
-        return;
-    }
-
-    pEncryptText = (MagicSquareText)dlsym(handle, "MagicSquareTextEncrypt");
-    pDecryptText = (MagicSquareText)dlsym(handle, "MagicSquareTextDecrypt");
-    pEncryptFile = (MagicSquareFile)dlsym(handle, "MagicSquareFileEncrypt");
-    pDecryptFile = (MagicSquareFile)dlsym(handle, "MagicSquareFileDecrypt");
+int main(int argc, char* argv[]) {
+    srand(time(0));
 
-    if (!pEncryptText || !pDecryptText || !pEncryptFile || !pDecryptFile) {
-        cerr << "ОШИБКА! Не удалось найти одну или несколько функций в библиотеке magicsquare.\n";
-        dlclose(handle);
-        return;
+    if (argc > 1) {
+        return RunBatchMode(argc, argv);
     }
 
-    string text, result, inPath, outPath, key;
-
-    cout << "\nШИФРОВАНИЕ МАГИЧЕСКИМ КВАДРАТОМ\n";
-    cout << "1. Зашифровать текст.\n";
-    cout << "2. Расшифровать текст.\n";
-    cout << "3. Зашифровать бинарный файл.\n";
-    cout << "4. Расшифровать бинарный файл.\n";
-    cout << "5. Зашифровать текстовый файл.\n";
-    cout << "6. Расшифровать текстовый файл.\n";
-    cout << "7. В главное меню.\n";
-
-    uint64_t choice = MenuChoice(1, 7);
-
-    if (choice == 1 || choice == 2) {
-        cout << "Введите текст для его обработки: ";
-        getline(cin, text);
-        
-        key = GetKeyUser("магического квадрата");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
-        }
-        
-        try {
-            if (choice == 1) {
-                result = pEncryptText(text, key);
-                cout << "Зашифрованный текст: " << result << endl;
-                SaveToFile(result, "зашифрованного текста");
-            } else {
-                result = pDecryptText(text, key);
-                cout << "Расшифрованный текст: " << result << endl;
-                SaveToFile(result, "расшифрованного текста");
-            }
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
-        }
-    } else if (choice == 3 || choice == 4) {
-        // Обработка бинарных файлов
-        cout << "Введите путь к исходному файлу: ";
-        getline(cin, inPath);
-        cout << "Введите путь к файлу, в который необходимо записать результат: ";
-        getline(cin, outPath);
-        
-        key = GetKeyUser("магического квадрата");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
-        }
-        
-        try {
-            if (choice == 3) {
-                pEncryptFile(inPath, outPath, key);
-                cout << "Бинарный файл зашифрован.\n";
-            } else {
-                pDecryptFile(inPath, outPath, key);
-                cout << "Бинарный файл расшифрован.\n";
-            }
-            
-            if (DisplayResult()) {
-                ifstream resultFile(outPath, ios::binary);
-                if (resultFile) {
-                    string content((istreambuf_iterator<char>(resultFile)), istreambuf_iterator<char>());
-                    cout << "Содержимое файла:\n" << content << endl;
-                    resultFile.close();
-                }
-            }
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
-        }
-    } else if (choice == 5 || choice == 6) {
-        // Обработка текстовых файлов
-        cout << "Введите путь к исходному файлу: ";
-        getline(cin, inPath);
-        cout << "Введите путь к файлу, в который необходимо записать результат: ";
-        getline(cin, outPath);
-        
-        key = GetKeyUser("магического квадрата");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
-        }
+    try {
+        cout << "ПРОГРАММА ШИФРОВАНИЯ/ДЕШИФРОВАНИЯ\n";
         
-        try {
-            ProcessTextFile(inPath, outPath, key, (choice == 5), "магического квадрата", 
-                          handle, pEncryptText, pDecryptText);
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
-        }
-    }
-
-    dlclose(handle);
-}
-
-void PermutationMenu() {
-    void* handle = nullptr;
-    PermutationText pEncryptText = nullptr, pDecryptText = nullptr;
-    PermutationFile pEncryptFile = nullptr, pDecryptFile = nullptr;
-
-    handle = dlopen("./build/lib/libpermutation.so", RTLD_LAZY);
-
-    if (!handle) {
-        cerr << "ОШИБКА! Не удалось загрузить библиотеку permutation.\n";
-        return;
-    }
-
-    pEncryptText = (PermutationText)dlsym(handle, "PermutationTextEncrypt");
-    pDecryptText = (PermutationText)dlsym(handle, "PermutationTextDecrypt");
-    pEncryptFile = (PermutationFile)dlsym(handle, "PermutationFileEncrypt");
-    pDecryptFile = (PermutationFile)dlsym(handle, "PermutationFileDecrypt");
-
-    if (!pEncryptText || !pDecryptText || !pEncryptFile || !pDecryptFile) {
-        cerr << "ОШИБКА! Не удалось найти одну или несколько функций в библиотеке permutation.\n";
-        dlclose(handle);
-        return;
-    }
-
-    string text, result, inPath, outPath, key;
-
-    cout << "\nШИФР ПЕРЕСТАНОВКИ\n";
-    cout << "1. Зашифровать текст.\n";
-    cout << "2. Расшифровать текст.\n";
-    cout << "3. Зашифровать бинарный файл.\n";
-    cout << "4. Расшифровать бинарный файл.\n";
-    cout << "5. Зашифровать текстовый файл.\n";
-    cout << "6. Расшифровать текстовый файл.\n";
-    cout << "7. В главное меню.\n";
-
-    uint64_t choice = MenuChoice(1, 7);
+        Authentication();
 
-    if (choice == 1 || choice == 2) {
-        // Обработка текста
-        cout << "Введите текст для его обработки: ";
-        getline(cin, text);
-        
-        key = GetKeyUser("шифра перестановки");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
-        }
-        
-        try {
-            if (choice == 1) {
-                result = pEncryptText(text, key);
-                cout << "Зашифрованный текст: " << result << endl;
-                SaveToFile(result, "зашифрованного текста");
-            } else {
-                result = pDecryptText(text, key);
-                cout << "Расшифрованный текст: " << result << endl;
-                SaveToFile(result, "расшифрованного текста");
-            }
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
-        }
-    } else if (choice == 3 || choice == 4) {
-        // Обработка бинарных файлов
-        cout << "Введите путь к исходному файлу: ";
-        getline(cin, inPath);
-        cout << "Введите путь к файлу, в который необходимо записать результат: ";
-        getline(cin, outPath);
-        
-        key = GetKeyUser("шифра перестановки");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
-        }
-        
-        try {
-            if (choice == 3) {
-                pEncryptFile(inPath, outPath, key);
-                cout << "Бинарный файл зашифрован.\n";
-            } else {
-                pDecryptFile(inPath, outPath, key);
-                cout << "Бинарный файл расшифрован.\n";
-            }
-            
-            if (DisplayResult()) {
-                ifstream resultFile(outPath, ios::binary);
-                if (resultFile) {
-                    string content((istreambuf_iterator<char>(resultFile)), istreambuf_iterator<char>());
-                    cout << "Содержимое файла:\n" << content << endl;
-                    resultFile.close();
-                }
-            }
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
+        // Библиотеки загружаются один раз и остаются открытыми до выхода
+        CipherRegistry registry;
+        vector<string> loadErrors;
+        registry.LoadDirectory(DEFAULT_LIB_DIRECTORY, loadErrors);
+        for (const auto& error : loadErrors) {
+            cerr << "ОШИБКА! " << error << endl;
         }
-    } else if (choice == 5 || choice == 6) {
-        // Обработка текстовых файлов
-        cout << "Введите путь к исходному файлу: ";
-        getline(cin, inPath);
-        cout << "Введите путь к файлу, в который необходимо записать результат: ";
-        getline(cin, outPath);
         
-        key = GetKeyUser("шифра перестановки");
-        if (key.empty()) {
-            dlclose(handle);
-            return;
+        const auto& ciphers = registry.Ciphers();
+        if (ciphers.empty()) {
+            cerr << "ОШИБКА! В каталоге " << DEFAULT_LIB_DIRECTORY << " не найдено ни одной библиотеки шифра.\n";
         }
         
-        try {
-            ProcessTextFile(inPath, outPath, key, (choice == 5), "шифра перестановки", handle, pEncryptText, pDecryptText);
-        } catch (const exception& e) {
-            cerr << "ОШИБКА! " << e.what() << endl;
-        }
-    }
-
-    dlclose(handle);
-}
-
-int main() {
-    srand(time(0));
-
-    try {
-        cout << "ПРОГРАММА ШИФРОВАНИЯ/ДЕШИФРОВАНИЯ\n";
-        
-        Authentication();
+        uint64_t keyGeneratorItem = ciphers.size() + 1;
+        uint64_t exitItem = ciphers.size() + 2;
 
         while (true) {
             cout << "\nГЛАВНОЕ МЕНЮ\n";
-            cout << "Выберите метод шифрования (1-3) или действие:\n";
-            cout << "1. Перестановка\n";
-            cout << "2. Матричная шифровка\n";
-            cout << "3. Магический квадрат\n";
-            cout << "4. Переход к генератору ключей\n";
-            cout << "5. Выход\n";
+            cout << "Выберите метод шифрования (1-" << ciphers.size() << ") или действие:\n";
+            for (size_t i = 0; i < ciphers.size(); ++i) {
+                cout << i + 1 << ". " << ciphers[i].plugin->displayName << "\n";
+            }
+            cout << keyGeneratorItem << ". Переход к генератору ключей\n";
+            cout << exitItem << ". Выход\n";
 
-            uint64_t choice = MenuChoice(1, 5);
+            uint64_t choice = MenuChoice(1, exitItem);
 
-            switch (static_cast<Menu>(choice)) {
-                case Menu::PERMUTATION: PermutationMenu(); break;
-                case Menu::MATRIX: MatrixMenu(); break;
-                case Menu::MAGIC_SQUARE: MagicSquareMenu(); break;
-                case Menu::KEY_GENERATOR: KeyGeneratorMenu(); break;
-                case Menu::EXIT: cout << "Выход из программы.\n"; return 0;
-                default: return 0;
+            if (choice == exitItem) {
+                cout << "Выход из программы.\n";
+                return 0;
+            } else if (choice == keyGeneratorItem) {
+                KeyGeneratorMenu(registry);
+            } else {
+                CipherMenu(*ciphers[choice - 1].plugin);
             }
         }
 
@@ -0,0 +1,209 @@
+#include "mappedio.h"
+#include "fdstream.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Отображение файла в память, снимаемое при выходе из области видимости
+class Mapping {
+public:
+    Mapping(int fd, size_t size, bool writable, bool hugePages, const string& path) : size(size) {
+        if (size == 0) {
+            return;
+        }
+        void* address = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                             writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            throw runtime_error("Не удалось отобразить файл в память: " + path);
+        }
+        data = static_cast<uint8_t*>(address);
+        // Подсказки ядру необязательны: ошибки madvise не мешают обработке
+        madvise(data, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        if (hugePages) {
+            madvise(data, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    ~Mapping() {
+        Release();
+    }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    uint8_t* Data() const { return data; }
+
+    void Release() {
+        if (data) {
+            munmap(data, size);
+            data = nullptr;
+        }
+    }
+
+private:
+    uint8_t* data = nullptr;
+    size_t size;
+};
+
+static uint64_t RegularFileSize(int fd, const string& path, bool& regular) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        throw runtime_error("Не удалось получить размер файла: " + path);
+    }
+    regular = S_ISREG(info.st_mode);
+    return static_cast<uint64_t>(info.st_size);
+}
+
+// Задаёт итоговый размер выходного файла. Место резервируется сразу: иначе его
+// нехватка обнаружилась бы только при записи в отображение, сигналом SIGBUS
+static void ResizeOutput(int fd, uint64_t size, const string& path) {
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        throw runtime_error("Не удалось задать размер выходного файла: " + path);
+    }
+    if (size > 0 && fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        throw runtime_error("Недостаточно места для выходного файла: " + path);
+    }
+}
+
+static int OpenMappedOutput(const string& outPath) {
+    // Для записи через отображение файл должен быть открыт и на чтение
+    int fd = open(outPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        throw runtime_error("Не удалось создать выходной файл: " + outPath);
+    }
+    return fd;
+}
+
+void MappedEncryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher, bool hugePages) {
+    FileDescriptor input(open(inPath.c_str(), O_RDONLY));
+    if (input.Get() < 0) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    bool regular = false;
+    uint64_t size = RegularFileSize(input.Get(), inPath, regular);
+    if (!regular) {
+        // Каналы и устройства не отображаются в память
+        StreamEncryptFile(inPath, outPath, cipher);
+        return;
+    }
+
+    FileDescriptor output(OpenMappedOutput(outPath));
+    size_t blockSize = cipher.blockSize;
+    uint64_t fullLength = size - size % blockSize;
+    uint64_t paddedLength = fullLength;
+    if (fullLength < size || (size == 0 && cipher.padEmpty)) {
+        paddedLength += blockSize;
+    }
+    ResizeOutput(output.Get(), paddedLength, outPath);
+    if (paddedLength == 0) {
+        return;
+    }
+
+    // Чтение и запись идут страничными отказами внутри преобразования и отдельно не измеряются
+    Mapping in(input.Get(), size, false, hugePages, inPath);
+    Mapping out(output.Get(), paddedLength, true, hugePages, outPath);
+    ParallelTransform(in.Data(), out.Data(), fullLength, blockSize, cipher.encrypt);
+
+    if (paddedLength > fullLength) {
+        vector<uint8_t> lastBlock(blockSize, 0);
+        CountAllocation(blockSize);
+        copy(in.Data() + fullLength, in.Data() + size, lastBlock.begin());
+        ParallelTransform(lastBlock.data(), out.Data() + fullLength, blockSize, blockSize, cipher.encrypt);
+    }
+    CountStat(Stat::BYTES_IN, size);
+    CountStat(Stat::BYTES_OUT, paddedLength);
+    CountStat(Stat::PADDING_ADDED, paddedLength - size);
+}
+
+void MappedDecryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher, bool hugePages) {
+    FileDescriptor input(open(inPath.c_str(), O_RDONLY));
+    if (input.Get() < 0) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    bool regular = false;
+    uint64_t size = RegularFileSize(input.Get(), inPath, regular);
+    if (!regular) {
+        StreamDecryptFile(inPath, outPath, cipher);
+        return;
+    }
+
+    Mapping in(input.Get(), size, false, hugePages, inPath);
+    const uint8_t* data = in.Data();
+    uint64_t dataSize = size;
+    size_t blockSize = cipher.blockSize;
+
+    FrameHeader header;
+    bool framed = DecodeFrameHeader(data, size, header);
+    uint64_t outputLength = 0;
+    if (framed) {
+        if (!FrameMatchesCipher(header, cipher)) {
+            throw runtime_error("Файл зашифрован другим шифром или с другим ключом");
+        }
+        data += FRAME_HEADER_SIZE;
+        dataSize -= FRAME_HEADER_SIZE;
+        outputLength = header.originalLength;
+        // Сравнение до округления: длина из повреждённого заголовка может быть близка к 2^64
+        if (outputLength > dataSize) {
+            throw runtime_error("Зашифрованный файл повреждён: данные короче длины из заголовка");
+        }
+        uint64_t needed = (outputLength + blockSize - 1) / blockSize * blockSize;
+        if (dataSize < needed) {
+            throw runtime_error(dataSize % blockSize != 0 ? "Зашифрованный файл повреждён: неполный последний блок"
+                                                          : "Зашифрованный файл повреждён: данные короче длины из заголовка");
+        }
+    } else {
+        outputLength = (dataSize + blockSize - 1) / blockSize * blockSize;
+    }
+
+    FileDescriptor output(OpenMappedOutput(outPath));
+    ResizeOutput(output.Get(), outputLength, outPath);
+    if (outputLength == 0) {
+        return;
+    }
+
+    Mapping out(output.Get(), outputLength, true, hugePages, outPath);
+    // Целые блоки есть и во входе, и в результате; последний блок файла без заголовка
+    // может быть неполным и дополняется нулями, как при потоковой обработке
+    uint64_t common = min(outputLength, dataSize);
+    uint64_t fullLength = common - common % blockSize;
+    ParallelTransform(data, out.Data(), fullLength, blockSize, cipher.decrypt);
+
+    uint64_t transformed = fullLength;
+    if (outputLength > fullLength) {
+        vector<uint8_t> lastBlock(blockSize, 0), decrypted(blockSize);
+        CountAllocation(blockSize);
+        CountAllocation(blockSize);
+        size_t available = static_cast<size_t>(min<uint64_t>(dataSize - fullLength, blockSize));
+        copy(data + fullLength, data + fullLength + available, lastBlock.begin());
+        ParallelTransform(lastBlock.data(), decrypted.data(), blockSize, blockSize, cipher.decrypt);
+        transformed += blockSize;
+        copy(decrypted.begin(), decrypted.begin() + (outputLength - fullLength), out.Data() + fullLength);
+    }
+
+    if (!framed) {
+        // Файл без заголовка: нули в конце - дополнение, файл обрезается после последнего ненулевого байта
+        uint64_t plainLength = outputLength;
+        {
+            TraceSpan span("padding");
+            while (plainLength > 0 && out.Data()[plainLength - 1] == 0) {
+                --plainLength;
+            }
+            span.SetBytes(outputLength - plainLength);
+        }
+        out.Release();
+        ResizeOutput(output.Get(), plainLength, outPath);
+        outputLength = plainLength;
+    }
+    CountStat(Stat::BYTES_IN, size);
+    CountStat(Stat::BYTES_OUT, outputLength);
+    CountStat(Stat::PADDING_STRIPPED, transformed - outputLength);
+}
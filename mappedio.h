@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include "blockio.h"
+
+// Обработка файла через отображение в память: вход отображается только для чтения,
+// выход заранее получает итоговый размер, и ядра преобразуют блоки прямо из одного
+// отображения в другое без промежуточных буферов. hugePages просит ядро использовать
+// большие страницы, где файловая система это поддерживает
+void MappedEncryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher, bool hugePages);
+
+// Расшифрование с распознаванием контейнера; результат совпадает со StreamDecryptFile
+void MappedDecryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher, bool hugePages);
@@ -1,4 +1,12 @@
 #include "matrix.h"
+#include "blockio.h"
+#include "parallel.h"
+#include "uringio.h"
+#include "stats.h"
+#include "trace.h"
+#include "textblock.h"
+#include "gatherkernel.h"
+#include "tablecache.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -9,17 +17,27 @@
 #include <random>
 #include <ctime>
 #include <stdexcept>
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <utility>
 
 using namespace std;
 
+const int MAX_MATRIX_SIZE = 4096;
+
+// Квадраты до этого размера переставляются ядрами с таблицами, вычисленными при компиляции;
+// таблицы больших строятся при первом обращении
+const int MAX_FIXED_MATRIX_SIZE = 20;
+
 int ParseMatrixSize(const string& key) {
     try {
         int size = stoi(key);
         if (size < 2) {
             throw invalid_argument("Размер матрицы должен быть не менее 2");
         }
-        if (size > 20) {
-            throw invalid_argument("Размер матрицы не должен превышать 20");
+        if (size > MAX_MATRIX_SIZE) {
+            throw invalid_argument("Размер матрицы не должен превышать " + to_string(MAX_MATRIX_SIZE));
         }
         return size;
     } catch (const exception& e) {
@@ -34,9 +52,12 @@ string GenerateMatrixKey() {
     return to_string(size);
 }
 
-vector<pair<int, int>> GenerateSpiralOrder(int size) {
-    vector<pair<int, int>> order;
-    order.reserve(size * size);
+// Обход квадрата по спирали от центра: order[k] - номер клетки (строка * size + столбец).
+// Заполняет и массив при компиляции, и вектор во время выполнения
+template <typename Order>
+constexpr void FillSpiralOrder(int size, Order& order) {
+    using Index = typename Order::value_type;
+    size_t count = 0;
     
     int center = size / 2;
     int x = center, y = center;
@@ -45,22 +66,22 @@ vector<pair<int, int>> GenerateSpiralOrder(int size) {
         y -= 1;
     }
     
-    int dx[] = {0, 1, 0, -1};
-    int dy[] = {1, 0, -1, 0};
+    const int dx[] = {0, 1, 0, -1};
+    const int dy[] = {1, 0, -1, 0};
     
     int direction = 0;
     int stepSize = 1;
     int stepCount = 0;
     
-    order.push_back({x, y});
+    order[count++] = static_cast<Index>(x * size + y);
     
-    while (order.size() < size * size) {
-        for (int i = 0; i < stepSize && order.size() < size * size; i++) {
+    while (count < order.size()) {
+        for (int i = 0; i < stepSize && count < order.size(); i++) {
             x += dx[direction];
             y += dy[direction];
             
             if (x >= 0 && x < size && y >= 0 && y < size) {
-                order.push_back({x, y});
+                order[count++] = static_cast<Index>(x * size + y);
             }
         }
         
@@ -71,221 +92,329 @@ vector<pair<int, int>> GenerateSpiralOrder(int size) {
             stepSize++;
         }
     }
-    
+}
+
+template <int Size>
+constexpr array<uint16_t, Size * Size> GenerateSpiralOrder() {
+    array<uint16_t, Size * Size> order = {};
+    FillSpiralOrder(Size, order);
     return order;
 }
 
-vector<string> SplitUTF8(const string& str) {
-    vector<string> characters;
-    
-    for (size_t i = 0; i < str.length();) {
-        unsigned char c = str[i];
-        size_t charLen = 1;
-        
-        if ((c & 0x80) == 0) {
-            charLen = 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            charLen = 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            charLen = 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            charLen = 4;
-        }
-        
-        characters.push_back(str.substr(i, charLen));
-        i += charLen;
+// Плоские таблицы выборки для блока Size * Size: encrypt[k] - позиция k-го байта по спирали,
+// decrypt - обратная к ней. Вычисляются при компиляции
+template <int Size>
+struct SpiralTableData {
+    array<uint16_t, Size * Size> encrypt;
+    array<uint16_t, Size * Size> decrypt;
+    array<uint8_t, Size * Size> encryptBytes;
+    array<uint8_t, Size * Size> decryptBytes;
+};
+
+template <int Size>
+constexpr SpiralTableData<Size> BuildSpiralTables() {
+    SpiralTableData<Size> tables = {};
+    tables.encrypt = GenerateSpiralOrder<Size>();
+    for (size_t k = 0; k < tables.encrypt.size(); k++) {
+        tables.decrypt[tables.encrypt[k]] = static_cast<uint16_t>(k);
     }
-    
-    return characters;
+    tables.encryptBytes = ByteTable(tables.encrypt);
+    tables.decryptBytes = ByteTable(tables.decrypt);
+    return tables;
 }
 
-vector<uint8_t> MatrixEncryptBinary(const vector<uint8_t>& data, int size) {
-    int matrixSize = size * size;
-    
-    vector<uint8_t> paddedData = data;
-    
-    if (paddedData.size() < matrixSize) {
-        paddedData.resize(matrixSize, 0);
-    } else if (paddedData.size() % matrixSize != 0) {
-        size_t padding = matrixSize - (paddedData.size() % matrixSize);
-        paddedData.resize(paddedData.size() + padding, 0);
+template <int Size>
+constexpr SpiralTableData<Size> spiralTables = BuildSpiralTables<Size>();
+
+// Ядра для квадрата Size * Size с таблицами, подставленными при компиляции;
+// квадраты до 8 * 8 помещаются в векторный регистр
+template <int Size>
+struct SpiralKernel {
+    static void Encrypt(const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherFixedVector<Size * Size>(src, dst, length, spiralTables<Size>.encrypt.data(), spiralTables<Size>.encryptBytes.data());
     }
-    
-    auto spiralOrder = GenerateSpiralOrder(size);
-    vector<uint8_t> result(paddedData.size());
-    
-    for (size_t block = 0; block < paddedData.size(); block += matrixSize) {
-        vector<vector<uint8_t>> matrix(size, vector<uint8_t>(size, 0));
-        
-        for (size_t i = 0; i < size; i++) {
-            for (size_t j = 0; j < size; j++) {
-                int dataIndex = block + i * size + j;
-                if (dataIndex < paddedData.size()) {
-                    matrix[i][j] = paddedData[dataIndex];
-                }
-            }
-        }
-        
-        // Читаем по спирали
-        for (size_t k = 0; k < matrixSize; k++) {
-            auto [i, j] = spiralOrder[k];
-            result[block + k] = matrix[i][j];
-        }
+    static void Decrypt(const uint8_t* src, uint8_t* dst, size_t length) {
+        GatherFixedVector<Size * Size>(src, dst, length, spiralTables<Size>.decrypt.data(), spiralTables<Size>.decryptBytes.data());
     }
-    
-    return result;
+};
+
+// Ядра по размеру квадрата от 1 (короткий текст шифруется квадратом меньше ключа) до MAX_FIXED_MATRIX_SIZE
+constexpr auto spiralKernels = MakeGatherKernels<SpiralKernel, 1, 1>(make_index_sequence<MAX_FIXED_MATRIX_SIZE>());
+
+// Таблицы и преобразования блоков одного размера; таблицы в виде векторов нужны выборке
+// символов текста и каскаду шифров
+struct SpiralTables {
+    vector<uint32_t> encrypt;
+    vector<uint32_t> decrypt;
+    unique_ptr<BlockPermutation> permutation; // у размеров, построенных во время выполнения
+    BlockTransform encryptBlocks;
+    BlockTransform decryptBlocks;
+    
+    size_t TableBytes() const {
+        return (encrypt.size() + decrypt.size()) * sizeof(uint32_t) + (permutation ? permutation->TableBytes() : 0);
+    }
+};
+
+template <int Size>
+shared_ptr<const SpiralTables> MakeSpiralTables() {
+    const auto& data = spiralTables<Size>;
+    auto tables = make_shared<SpiralTables>();
+    tables->encrypt.assign(data.encrypt.begin(), data.encrypt.end());
+    tables->decrypt.assign(data.decrypt.begin(), data.decrypt.end());
+    tables->encryptBlocks = spiralKernels[Size - 1].encrypt;
+    tables->decryptBlocks = spiralKernels[Size - 1].decrypt;
+    return tables;
 }
 
-vector<uint8_t> MatrixDecryptBinary(const vector<uint8_t>& encryptedData, int size) {
-    int matrixSize = size * size;
-    
-    auto spiralOrder = GenerateSpiralOrder(size);
-    vector<uint8_t> result(encryptedData.size());
-    
-    for (size_t block = 0; block < encryptedData.size(); block += matrixSize) {
-        vector<vector<uint8_t>> matrix(size, vector<uint8_t>(size, 0));
+template <size_t... Offsets>
+vector<shared_ptr<const SpiralTables>> MakeAllSpiralTables(index_sequence<Offsets...>) {
+    return {MakeSpiralTables<static_cast<int>(Offsets) + 1>()...};
+}
 
-        for (size_t k = 0; k < matrixSize; k++) {
-            auto [i, j] = spiralOrder[k];
-            matrix[i][j] = encryptedData[block + k];
-        }
-        
-        for (size_t i = 0; i < size; i++) {
-            for (size_t j = 0; j < size; j++) {
-                result[block + i * size + j] = matrix[i][j];
-            }
-        }
+// Квадрат больше MAX_FIXED_MATRIX_SIZE: таблицы строятся при первом обращении,
+// блоки переставляет BlockPermutation
+shared_ptr<const SpiralTables> BuildSpiralTables(int size) {
+    TraceSpan span("table_build", static_cast<uint64_t>(size) * size);
+    auto tables = make_shared<SpiralTables>();
+    tables->encrypt.resize(static_cast<size_t>(size) * size);
+    FillSpiralOrder(size, tables->encrypt);
+    tables->decrypt.resize(tables->encrypt.size());
+    for (size_t k = 0; k < tables->encrypt.size(); k++) {
+        tables->decrypt[tables->encrypt[k]] = static_cast<uint32_t>(k);
     }
     
-    while (!result.empty() && result.back() == 0) {
-        result.pop_back();
+    tables->permutation = make_unique<BlockPermutation>(tables->encrypt, tables->decrypt);
+    const BlockPermutation* permutation = tables->permutation.get();
+    tables->encryptBlocks = [permutation](const uint8_t* src, uint8_t* dst, size_t length) {
+        permutation->Gather(src, dst, length);
+    };
+    tables->decryptBlocks = [permutation](const uint8_t* src, uint8_t* dst, size_t length) {
+        permutation->Scatter(src, dst, length);
+    };
+    return tables;
+}
+
+shared_ptr<const SpiralTables> GetSpiralTables(int size) {
+    if (size <= MAX_FIXED_MATRIX_SIZE) {
+        // Сами таблицы вычислены при компиляции; при первом обращении они копируются в векторы
+        static const vector<shared_ptr<const SpiralTables>> tables = [] {
+            TraceSpan span("table_build");
+            return MakeAllSpiralTables(make_index_sequence<MAX_FIXED_MATRIX_SIZE>());
+        }();
+        return tables[size - 1];
     }
     
-    return result;
+    static TableCache<SpiralTables> cache;
+    return cache.Get(size, [size] {
+        return BuildSpiralTables(size);
+    });
 }
 
-string MatrixTextEncrypt(const string& text, const string& key) {
-    int size = ParseMatrixSize(key);
+BlockCipher MakeMatrixCipher(int size) {
+    shared_ptr<const SpiralTables> tables = GetSpiralTables(size);
+    
+    BlockCipher cipher;
+    cipher.blockSize = static_cast<size_t>(size) * size;
+    cipher.encrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        tables->encryptBlocks(src, dst, length);
+    };
+    cipher.decrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        tables->decryptBlocks(src, dst, length);
+    };
+    cipher.padEmpty = true;
+    cipher.cipherId = CipherId::MATRIX;
+    cipher.keyParam = static_cast<uint32_t>(size);
+    return cipher;
+}
+
+void MatrixSetChunkSize(size_t bytes) {
+    SetStreamChunkSize(bytes);
+}
+
+void MatrixSetIoBackend(const string& name) {
+    SetIoBackend(name);
+}
+
+void MatrixSetThreadCount(unsigned count) {
+    SetThreadCount(count);
+}
+
+AsyncIoStats MatrixGetAsyncIoStats() {
+    return GetAsyncIoStats();
+}
+
+CipherStats MatrixGetStats() {
+    return GetCipherStats();
+}
+
+void MatrixResetStats() {
+    ResetCipherStats();
+}
+
+void MatrixSetStatsEnabled(bool enabled) {
+    SetStatsEnabled(enabled);
+}
+
+// Разобранный ключ и таблицы спирали для него
+struct MatrixContext {
+    int size;
+    shared_ptr<const SpiralTables> tables;
+    BlockCipher cipher; // файловое преобразование ключа: им же переставляются данные в памяти
+};
+
+MatrixContext* MatrixCreateContext(const string& key) {
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    auto context = make_unique<MatrixContext>();
+    context->size = ParseMatrixSize(key);
+    context->tables = GetSpiralTables(context->size);
+    context->cipher = MakeMatrixCipher(context->size);
+    return context.release();
+}
+
+void MatrixDestroyContext(MatrixContext* context) {
+    delete context;
+}
+
+// Текст из одних ASCII-символов переставляется тем же байтовым ядром, что и файлы
+string GatherAsciiText(const string& text, size_t blockSize, const BlockTransform& transform, bool trimSpaces) {
+    return TransformAsciiText(text, blockSize, trimSpaces, [&](const char* src, char* dst, size_t length) {
+        ParallelTransform(reinterpret_cast<const uint8_t*>(src), reinterpret_cast<uint8_t*>(dst), length, blockSize, transform);
+    });
+}
+
+string TransformText(const string& text, const SpiralTables& tables, bool encrypt) {
+    const vector<uint32_t>& table = encrypt ? tables.encrypt : tables.decrypt;
+    if (IsAscii(text.data(), text.size())) {
+        return GatherAsciiText(text, table.size(), encrypt ? tables.encryptBlocks : tables.decryptBlocks, !encrypt);
+    }
+    return GatherText(text, table, !encrypt);
+}
+
+// Короткий текст шифруется квадратом меньшего размера, в который он помещается
+shared_ptr<const SpiralTables> GetEncryptTables(const MatrixContext* context, size_t textLength) {
+    int size = context->size;
     
-    if (text.length() < size * size) {
-        int minSize = static_cast<int>(ceil(sqrt(text.length())));
+    if (textLength < size * size) {
+        int minSize = static_cast<int>(ceil(sqrt(textLength)));
         if (minSize < size) {
             size = minSize;
         }
     }
     
-    vector<string> characters = SplitUTF8(text);
-    string result;
-    
-    int matrixSize = size * size;
-    
-    for (size_t i = 0; i < characters.size(); i += matrixSize) {
-        size_t currentBlockSize = min(static_cast<size_t>(matrixSize), characters.size() - i);
-        
-        vector<string> block;
-        for (size_t j = 0; j < currentBlockSize; ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        while (block.size() < static_cast<size_t>(matrixSize)) {
-            block.push_back(" ");
-        }
-        
-        auto spiralOrder = GenerateSpiralOrder(size);
-        
-        vector<vector<string>> matrix(size, vector<string>(size, " "));
-        for (int row = 0; row < size; row++) {
-            for (int col = 0; col < size; col++) {
-                size_t index = row * size + col;
-                if (index < block.size()) {
-                    matrix[row][col] = block[index];
-                }
-            }
-        }
-        
-        for (int k = 0; k < matrixSize; k++) {
-            auto [row, col] = spiralOrder[k];
-            result += matrix[row][col];
-        }
+    if (size == context->size) {
+        return context->tables;
     }
-    
-    return result;
+    return GetSpiralTables(size);
 }
 
-string MatrixTextDecrypt(const string& encryptedText, const string& key) {
-    int size = ParseMatrixSize(key);
-    
-    vector<string> characters = SplitUTF8(encryptedText);
-    string result;
-    
-    int matrixSize = size * size;
-    
-    auto spiralOrder = GenerateSpiralOrder(size);
-    
-    for (size_t i = 0; i < characters.size(); i += matrixSize) {
-        vector<string> block;
-        for (size_t j = 0; j < static_cast<size_t>(matrixSize) && (i + j) < characters.size(); ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        vector<vector<string>> matrix(size, vector<string>(size, " "));
-        for (int k = 0; k < matrixSize && k < block.size(); k++) {
-            auto [row, col] = spiralOrder[k];
-            matrix[row][col] = block[k];
-        }
-        
-        for (int row = 0; row < size; row++) {
-            for (int col = 0; col < size; col++) {
-                result += matrix[row][col];
-            }
-        }
+string MatrixEncryptWithContext(const MatrixContext* context, const string& text) {
+    CountStat(Stat::CALLS);
+    if (text.empty()) {
+        return "";
     }
     
-    while (!result.empty() && result.back() == ' ') {
-        result.pop_back();
-    }
-    
-    return result;
+    return TransformText(text, *GetEncryptTables(context, text.length()), true);
+}
+
+string MatrixDecryptWithContext(const MatrixContext* context, const string& encryptedText) {
+    CountStat(Stat::CALLS);
+    return TransformText(encryptedText, *context->tables, false);
+}
+
+string MatrixTextEncrypt(const string& text, const string& key) {
+    unique_ptr<MatrixContext> context(MatrixCreateContext(key));
+    return MatrixEncryptWithContext(context.get(), text);
+}
+
+string MatrixTextDecrypt(const string& encryptedText, const string& key) {
+    unique_ptr<MatrixContext> context(MatrixCreateContext(key));
+    return MatrixDecryptWithContext(context.get(), encryptedText);
+}
+
+// Шифр для ключа файловой операции: учитывается вызов и время разбора ключа
+BlockCipher MatrixCipherForKey(const string& key) {
+    CountStat(Stat::CALLS);
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    return MakeMatrixCipher(ParseMatrixSize(key));
 }
 
 void MatrixFileEncrypt(const string& inPath, const string& outPath, const string& key) {
-    int size = ParseMatrixSize(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)),istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto encrypted = MatrixEncryptBinary(content, size);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
-    }
-    outputFile.write(reinterpret_cast<const char*>(encrypted.data()), encrypted.size());
-    outputFile.close();
+    EncryptFile(inPath, outPath, MatrixCipherForKey(key));
+}
+
+void MatrixFileEncryptFramed(const string& inPath, const string& outPath, const string& key) {
+    StreamEncryptFileFramed(inPath, outPath, MatrixCipherForKey(key));
 }
 
 void MatrixFileDecrypt(const string& inPath, const string& outPath, const string& key) {
+    DecryptFile(inPath, outPath, MatrixCipherForKey(key));
+}
+
+void MatrixStreamEncrypt(int inFd, int outFd, const string& key) {
+    StreamEncryptDescriptor(inFd, outFd, MatrixCipherForKey(key));
+}
+
+void MatrixStreamDecrypt(int inFd, int outFd, const string& key) {
+    StreamDecryptDescriptor(inFd, outFd, MatrixCipherForKey(key));
+}
+
+size_t MatrixDecryptRange(const string& inPath, const string& key, uint64_t offset, uint64_t length, uint8_t* out) {
+    return DecryptFileRange(inPath, MatrixCipherForKey(key), offset, length, out);
+}
+
+size_t MatrixEncryptInPlace(const MatrixContext* context, uint8_t* buffer, size_t length, size_t capacity) {
+    CountStat(Stat::CALLS);
+    return EncryptBuffer(buffer, length, capacity, context->cipher);
+}
+
+size_t MatrixDecryptInPlace(const MatrixContext* context, uint8_t* buffer, size_t length) {
+    CountStat(Stat::CALLS);
+    return DecryptBuffer(buffer, length, context->cipher);
+}
+
+size_t MatrixBufferBound(const MatrixContext* context, size_t length) {
+    return EncryptedBufferSize(length, context->cipher);
+}
+
+vector<uint32_t> MatrixEncryptTable(const string& key) {
+    return GetSpiralTables(ParseMatrixSize(key))->encrypt;
+}
+
+size_t MatrixTextEncryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                              char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<MatrixContext> context(MatrixCreateContext(key));
+    // Таблицы короткого сообщения держатся, пока идёт его перестановка
+    shared_ptr<const SpiralTables> current;
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, false, [&](size_t length) -> const vector<uint32_t>& {
+        current = GetEncryptTables(context.get(), length);
+        return current->encrypt;
+    });
+}
+
+size_t MatrixTextDecryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                              char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<MatrixContext> context(MatrixCreateContext(key));
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, true, [&](size_t) -> const vector<uint32_t>& {
+        return context->tables->decrypt;
+    });
+}
+
+size_t MatrixTextBatchBound(const string& key, const size_t* lengths, size_t count) {
     int size = ParseMatrixSize(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)),istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto decrypted = MatrixDecryptBinary(content, size);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
-    }
-    outputFile.write(reinterpret_cast<const char*>(decrypted.data()), decrypted.size());
-    outputFile.close();
+    return GatherTextBatchBound(lengths, count, static_cast<size_t>(size) * size);
+}
+
+const CipherPlugin* CipherPluginDescriptor() {
+    static const CipherPlugin plugin = {
+        CIPHER_PLUGIN_VERSION, 2, "matrix", "Матричная шифровка", "МАТРИЧНАЯ ШИФРОВКА", "матричной шифровки",
+        MatrixTextEncrypt, MatrixTextDecrypt,
+        MatrixFileEncrypt, MatrixFileDecrypt, MatrixFileEncryptFramed, MatrixDecryptRange,
+        MatrixStreamEncrypt, MatrixStreamDecrypt,
+        GenerateMatrixKey, MatrixSetChunkSize, MatrixSetIoBackend, MatrixSetThreadCount,
+        MatrixGetAsyncIoStats, MatrixGetStats, MatrixResetStats, MatrixSetStatsEnabled,
+        MatrixEncryptTable
+    };
+    return &plugin;
 }
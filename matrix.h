@@ -1,12 +1,68 @@
 #pragma once
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "plugin.h"
 
 #define MATRIX_API
 
+// Разобранный ключ с готовыми таблицами прямого и обратного преобразования
+struct MatrixContext;
+
 extern "C" {
     MATRIX_API std::string MatrixTextEncrypt(const std::string& text, const std::string& key);
     MATRIX_API std::string MatrixTextDecrypt(const std::string& text, const std::string& key);
+    // Контекст создаётся один раз на ключ и используется для любого числа сообщений
+    MATRIX_API MatrixContext* MatrixCreateContext(const std::string& key);
+    MATRIX_API std::string MatrixEncryptWithContext(const MatrixContext* context, const std::string& text);
+    MATRIX_API std::string MatrixDecryptWithContext(const MatrixContext* context, const std::string& text);
+    MATRIX_API void MatrixDestroyContext(MatrixContext* context);
+    // Пакетная обработка count сообщений одним ключом: результат сообщения i записывается
+    // в out[offsets[i], offsets[i + 1]), в offsets count + 1 элементов. Возвращает общий размер;
+    // достаточный размер out даёт TextBatchBound, при нехватке бросается length_error
+    MATRIX_API size_t MatrixTextEncryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    MATRIX_API size_t MatrixTextDecryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    MATRIX_API size_t MatrixTextBatchBound(const std::string& key, const size_t* lengths, size_t count);
     MATRIX_API void MatrixFileEncrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Шифрование в контейнер с заголовком, хранящим исходную длину; FileDecrypt распознаёт его сам
+    MATRIX_API void MatrixFileEncryptFramed(const std::string& inPath, const std::string& outPath, const std::string& key);
     MATRIX_API void MatrixFileDecrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Потоковая обработка открытых дескрипторов (каналов, stdin/stdout); дескрипторы не закрываются
+    MATRIX_API void MatrixStreamEncrypt(int inFd, int outFd, const std::string& key);
+    MATRIX_API void MatrixStreamDecrypt(int inFd, int outFd, const std::string& key);
+    // Расшифрование байт [offset, offset + length) исходного файла с чтением только нужных блоков;
+    // возвращает количество записанных в out байт
+    MATRIX_API size_t MatrixDecryptRange(const std::string& inPath, const std::string& key, uint64_t offset, uint64_t length, uint8_t* out);
+    // Шифрование данных в памяти на месте, без выделения памяти: buffer[0, length) дополняется
+    // нулями до целого блока и переставляется внутри buffer. Вызывающий может сразу выделить
+    // MatrixBufferBound байт; при меньшем capacity бросается length_error. Возвращает длину результата
+    MATRIX_API size_t MatrixEncryptInPlace(const MatrixContext* context, uint8_t* buffer, size_t length, size_t capacity);
+    // Расшифрование на месте; length кратна размеру блока. Возвращает длину данных без нулей
+    // в конце, как при расшифровании файла без заголовка
+    MATRIX_API size_t MatrixDecryptInPlace(const MatrixContext* context, uint8_t* buffer, size_t length);
+    // Размер буфера для шифрования length байт на месте
+    MATRIX_API size_t MatrixBufferBound(const MatrixContext* context, size_t length);
     MATRIX_API std::string GenerateMatrixKey();
+    // Размер порции потоковой обработки файлов (по умолчанию 4 МБ); 0 - обработка файла целиком
+    MATRIX_API void MatrixSetChunkSize(size_t bytes);
+    // Механизм файлового ввода-вывода: "stream" (по умолчанию), "whole", "mmap", "mmap-huge",
+    // "uring" или "uring:N" - асинхронный ввод-вывод с глубиной очереди N
+    MATRIX_API void MatrixSetIoBackend(const std::string& name);
+    // Количество потоков поблочной обработки (по умолчанию 1); 0 - по числу ядер
+    MATRIX_API void MatrixSetThreadCount(unsigned count);
+    // Статистика очереди механизма "uring" для последней файловой операции этого потока
+    MATRIX_API AsyncIoStats MatrixGetAsyncIoStats();
+    // Счётчики вызовов, объёмов и времени по фазам, сумма по всем потокам; сбор включается
+    // SetStatsEnabled или переменной окружения CRYPTOGRAPHY_STATS
+    MATRIX_API CipherStats MatrixGetStats();
+    MATRIX_API void MatrixResetStats();
+    MATRIX_API void MatrixSetStatsEnabled(bool enabled);
+    // Таблица выборки файлового шифрования одного блока для ключа: байт k зашифрованного
+    // блока берётся из позиции table[k]; по ней каскад шифров составляет общую перестановку
+    MATRIX_API std::vector<uint32_t> MatrixEncryptTable(const std::string& key);
+    // Описание шифра для реестра библиотек программы
+    MATRIX_API const CipherPlugin* CipherPluginDescriptor();
 }
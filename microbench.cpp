@@ -0,0 +1,350 @@
+// Микротесты производительности библиотек шифров: текстовые и файловые функции
+// и генерация ключей всех загруженных шифров на разных размерах, ключах и данных.
+// Запуск: make bench (параметры - переменная BENCH_ARGS, см. --help)
+#include "registry.h"
+#include "cpudispatch.h"
+#include "benchutil.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+
+// Подсчёт выделений памяти: замена глобальных operator new действует и внутри
+// библиотек, так как программа собирается с -rdynamic
+static atomic<uint64_t> allocationCount(0);
+static atomic<uint64_t> allocatedBytes(0);
+
+static void* CountedAllocate(size_t size, size_t alignment) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocatedBytes.fetch_add(size, memory_order_relaxed);
+    void* pointer = nullptr;
+    if (alignment <= alignof(max_align_t)) {
+        pointer = malloc(size ? size : 1);
+    } else if (posix_memalign(&pointer, alignment, size ? size : 1) != 0) {
+        pointer = nullptr;
+    }
+    if (!pointer) {
+        throw bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t size) { return CountedAllocate(size, 0); }
+void* operator new[](size_t size) { return CountedAllocate(size, 0); }
+void* operator new(size_t size, align_val_t alignment) { return CountedAllocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment) { return CountedAllocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+
+namespace {
+
+struct BenchOptions {
+    string libDirectory = DEFAULT_LIB_DIRECTORY;
+    string cipherName;
+    string workDirectory = "/tmp";
+    string jsonPath;
+    string label;
+    uint64_t minSize = 64;
+    uint64_t maxSize = 1ULL << 30;
+    double minTime = 0.2;
+};
+
+struct Measurement {
+    uint64_t iterations = 0;
+    double seconds = 0;
+    double allocationsPerCall = 0;
+    double allocatedBytesPerCall = 0;
+    long peakRssKb = 0;
+};
+
+struct BenchResult {
+    string cipher;
+    string function;
+    string key;
+    string input;
+    uint64_t bytes;
+    Measurement measurement;
+};
+
+void PrintUsage(ostream& out) {
+    out << "Использование: microbench [параметры]\n"
+        << "  --lib-dir КАТ     каталог библиотек шифров (по умолчанию " << DEFAULT_LIB_DIRECTORY << ")\n"
+        << "  --cipher ИМЯ      только один шифр\n"
+        << "  --min-size БАЙТ   наименьший размер входа (по умолчанию 64)\n"
+        << "  --max-size БАЙТ   наибольший размер входа (по умолчанию 1 ГБ)\n"
+        << "  --min-time СЕК    наименьшее время измерения одного случая (по умолчанию 0.2)\n"
+        << "  --dir КАТ         каталог для временных файлов (по умолчанию /tmp)\n"
+        << "  --json ФАЙЛ       записать результаты в JSON\n"
+        << "  --label ТЕКСТ     метка запуска в JSON, например хеш коммита\n";
+}
+
+// Повторяет call, пока не пройдёт minTime секунд (хотя бы один раз). Небольшие
+// случаи сначала прогреваются, чтобы не учитывать первое построение таблиц. Пик памяти
+// считается от начала случая и включает уже выделенные входные данные
+Measurement Measure(const function<void()>& call, uint64_t bytes, double minTime) {
+    ResetPeakRss();
+    if (bytes < (16 << 20)) {
+        call();
+    }
+
+    Measurement result;
+    uint64_t allocations = allocationCount.load();
+    uint64_t allocated = allocatedBytes.load();
+    auto start = chrono::steady_clock::now();
+    do {
+        call();
+        ++result.iterations;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (result.seconds < minTime);
+
+    result.allocationsPerCall = static_cast<double>(allocationCount.load() - allocations) / result.iterations;
+    result.allocatedBytesPerCall = static_cast<double>(allocatedBytes.load() - allocated) / result.iterations;
+    result.peakRssKb = PeakRssKb();
+    return result;
+}
+
+// Ключи всех допустимых размеров; для шифров, о которых микротест не знает, - сгенерированный
+vector<string> BenchKeys(const CipherPlugin& cipher) {
+    vector<string> keys;
+    string name = cipher.name;
+    if (name == "permutation") {
+        for (int length : {2, 3, 4, 5, 6, 7, 8, 16, 64, 256}) {
+            // Циклический сдвиг: 2-3-...-N-1
+            string key;
+            for (int i = 0; i < length; ++i) {
+                key += (i ? "-" : "") + to_string((i + 1) % length + 1);
+            }
+            keys.push_back(key);
+        }
+    } else if (name == "matrix") {
+        for (int size = 2; size <= 20; ++size) {
+            keys.push_back(to_string(size));
+        }
+        // Размеры с таблицами, построенными во время выполнения: BlockPermutation переставляет
+        // блок 64 и 512 за один проход, а разбросанную спираль 4096 - за два через буфер потока
+        for (int size : {64, 512, 4096}) {
+            keys.push_back(to_string(size));
+        }
+    } else if (name == "magicsquare") {
+        for (int size : {3, 4, 5, 6, 7, 8, 9, 64, 512, 4096}) {
+            keys.push_back(to_string(size));
+        }
+    } else {
+        keys.push_back(cipher.generateKey());
+    }
+    return keys;
+}
+
+// Входные данные с постоянным зерном, чтобы запуски на разных коммитах были сравнимы
+string MakeInput(const string& kind, uint64_t size) {
+    mt19937_64 random(42);
+    string data;
+    data.reserve(size);
+    if (kind == "ascii") {
+        const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,";
+        while (data.size() < size) {
+            data += alphabet[random() % (sizeof(alphabet) - 1)];
+        }
+    } else if (kind == "cyrillic") {
+        // Буквы а-я (U+0430..U+044F) по два байта и пробелы
+        while (data.size() < size) {
+            unsigned letter = random() % 33;
+            if (letter == 32 || size - data.size() < 2) {
+                data += ' ';
+            } else {
+                data += static_cast<char>(0xD0 + (letter >= 16));
+                data += static_cast<char>(letter < 16 ? 0xB0 + letter : 0x80 + letter - 16);
+            }
+        }
+    } else {
+        while (data.size() < size) {
+            uint64_t word = random();
+            size_t count = min<uint64_t>(8, size - data.size());
+            data.append(reinterpret_cast<const char*>(&word), count);
+        }
+    }
+    return data;
+}
+
+void WriteFile(const string& path, const string& data) {
+    ofstream file(path, ios::binary);
+    file.write(data.data(), data.size());
+    if (!file) {
+        throw runtime_error("Не удалось записать файл: " + path);
+    }
+}
+
+vector<uint64_t> BenchSizes(const BenchOptions& options) {
+    vector<uint64_t> sizes;
+    for (uint64_t size = 64; size <= options.maxSize; size *= 16) {
+        if (size >= options.minSize) {
+            sizes.push_back(size);
+        }
+    }
+    return sizes;
+}
+
+void PrintResult(const BenchResult& result) {
+    const Measurement& m = result.measurement;
+    char line[256];
+    if (result.bytes > 0) {
+        double nsPerByte = m.seconds * 1e9 / (static_cast<double>(m.iterations) * result.bytes);
+        snprintf(line, sizeof(line), "%-12s %-12s %-9s %-12.12s %11llu  %8.3f нс/Б  %7.3f ГБ/с  %8.1f выд.  %9ld КБ",
+                 result.cipher.c_str(), result.function.c_str(), result.input.c_str(), result.key.c_str(),
+                 static_cast<unsigned long long>(result.bytes), nsPerByte, 1 / nsPerByte, m.allocationsPerCall, m.peakRssKb);
+    } else {
+        snprintf(line, sizeof(line), "%-12s %-12s %-9s %-12s %11s  %8.0f нс/вызов          %8.1f выд.  %9ld КБ",
+                 result.cipher.c_str(), result.function.c_str(), "-", "-", "-",
+                 m.seconds * 1e9 / m.iterations, m.allocationsPerCall, m.peakRssKb);
+    }
+    cout << line << endl;
+}
+
+void WriteJson(const string& path, const BenchOptions& options, const vector<BenchResult>& results) {
+    ofstream out(path);
+    const char* isa = getenv(ISA_ENV);
+    out << "{\n  \"label\": " << JsonString(options.label) << ",\n"
+        << "  \"isa\": " << JsonString(isa ? isa : "auto") << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        const Measurement& m = r.measurement;
+        double callNs = m.seconds * 1e9 / m.iterations;
+        char numbers[256];
+        snprintf(numbers, sizeof(numbers),
+                 "\"bytes\": %llu, \"iterations\": %llu, \"ns_per_call\": %.1f, \"ns_per_byte\": %.6f, \"gb_per_s\": %.6f, "
+                 "\"allocations_per_call\": %.2f, \"allocated_bytes_per_call\": %.0f, \"peak_rss_kb\": %ld",
+                 static_cast<unsigned long long>(r.bytes), static_cast<unsigned long long>(m.iterations), callNs,
+                 r.bytes ? callNs / r.bytes : 0.0, r.bytes ? r.bytes / callNs : 0.0,
+                 m.allocationsPerCall, m.allocatedBytesPerCall, m.peakRssKb);
+        out << "    {\"cipher\": " << JsonString(r.cipher) << ", \"function\": " << JsonString(r.function)
+            << ", \"key\": " << JsonString(r.key) << ", \"input\": " << JsonString(r.input) << ", " << numbers << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    if (!out) {
+        throw runtime_error("Не удалось записать файл: " + path);
+    }
+}
+
+void BenchCipher(const CipherPlugin& cipher, const BenchOptions& options, vector<BenchResult>& results) {
+    auto record = [&](const string& name, const string& key, const string& input, uint64_t bytes, const function<void()>& call) {
+        results.push_back({cipher.name, name, key, input, bytes, Measure(call, bytes, options.minTime)});
+        PrintResult(results.back());
+    };
+
+    record("GenerateKey", "", "", 0, [&]() { cipher.generateKey(); });
+
+    string inPath = options.workDirectory + "/microbench_" + to_string(getpid()) + ".in";
+    string encryptedPath = inPath + ".enc";
+    string decryptedPath = inPath + ".dec";
+
+    for (uint64_t size : BenchSizes(options)) {
+        for (const string kind : {"ascii", "cyrillic", "binary"}) {
+            string data = MakeInput(kind, size);
+            WriteFile(inPath, data);
+            for (const string& key : BenchKeys(cipher)) {
+                if (kind != "binary") {
+                    string encrypted;
+                    record("TextEncrypt", key, kind, size, [&]() { encrypted = cipher.textEncrypt(data, key); });
+                    record("TextDecrypt", key, kind, encrypted.size(), [&]() { cipher.textDecrypt(encrypted, key); });
+                }
+                record("FileEncrypt", key, kind, size, [&]() { cipher.fileEncrypt(inPath, encryptedPath, key); });
+                record("FileDecrypt", key, kind, size, [&]() { cipher.fileDecrypt(encryptedPath, decryptedPath, key); });
+            }
+        }
+    }
+
+    remove(inPath.c_str());
+    remove(encryptedPath.c_str());
+    remove(decryptedPath.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto value = [&]() -> string {
+                if (i + 1 >= argc) {
+                    throw invalid_argument("Не указано значение параметра " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--lib-dir") {
+                options.libDirectory = value();
+            } else if (arg == "--cipher") {
+                options.cipherName = value();
+            } else if (arg == "--min-size") {
+                options.minSize = stoull(value());
+            } else if (arg == "--max-size") {
+                options.maxSize = stoull(value());
+            } else if (arg == "--min-time") {
+                options.minTime = stod(value());
+            } else if (arg == "--dir") {
+                options.workDirectory = value();
+            } else if (arg == "--json") {
+                options.jsonPath = value();
+            } else if (arg == "--label") {
+                options.label = value();
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(cout);
+                return 0;
+            } else {
+                throw invalid_argument("Неизвестный параметр: " + arg);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        PrintUsage(cerr);
+        return 2;
+    }
+
+    CipherRegistry registry;
+    vector<string> errors;
+    registry.LoadDirectory(options.libDirectory, errors);
+    for (const string& error : errors) {
+        cerr << "Предупреждение: " << error << endl;
+    }
+
+    vector<BenchResult> results;
+    try {
+        for (const LoadedCipher& loaded : registry.Ciphers()) {
+            if (options.cipherName.empty() || options.cipherName == loaded.plugin->name) {
+                BenchCipher(*loaded.plugin, options, results);
+            }
+        }
+        if (results.empty()) {
+            cerr << "ОШИБКА! Нет шифров для измерения в каталоге " << options.libDirectory << endl;
+            return 1;
+        }
+        if (!options.jsonPath.empty()) {
+            WriteJson(options.jsonPath, options, results);
+            cout << "Результаты записаны в " << options.jsonPath << endl;
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
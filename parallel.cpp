@@ -0,0 +1,181 @@
+#include "parallel.h"
+#include "stats.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Минимальная часть, ради которой имеет смысл будить другой поток
+static const size_t MIN_PARALLEL_PART = 256 << 10;
+
+static atomic<unsigned> threadCount(1);
+
+void SetThreadCount(unsigned count) {
+    if (count == 0) {
+        count = max(1u, thread::hardware_concurrency());
+    }
+    threadCount = count;
+}
+
+unsigned GetThreadCount() {
+    return threadCount;
+}
+
+// Пул постоянных потоков. Задачи одного вызова разбираются через общий атомарный счётчик,
+// поэтому освободившийся поток сразу берёт следующую часть и нагрузка выравнивается
+class ThreadPool {
+public:
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Возвращает false, если пул занят другим вызовом. Исключение первой упавшей задачи
+    // бросается после того, как все потоки вышли из вызова: задача ссылается на стек вызывающего
+    bool TryRun(size_t taskCount, unsigned threads, const function<void(size_t)>& task) {
+        unique_lock<mutex> runLock(runMutex, try_to_lock);
+        if (!runLock.owns_lock()) {
+            return false;
+        }
+        EnsureWorkers(threads - 1);
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            job = &task;
+            jobSize = taskCount;
+            nextTask = 0;
+            failure = nullptr;
+            jobWorkers = min<size_t>(threads - 1, taskCount);
+            activeWorkers = jobWorkers;
+            ++generation;
+        }
+        wake.notify_all();
+
+        Work();
+
+        unique_lock<mutex> lock(stateMutex);
+        done.wait(lock, [this] { return activeWorkers == 0; });
+        job = nullptr;
+        if (failure) {
+            exception_ptr error = failure;
+            failure = nullptr;
+            rethrow_exception(error);
+        }
+        return true;
+    }
+
+private:
+    // Вызывается под runMutex, поэтому generation не меняется
+    void EnsureWorkers(size_t count) {
+        while (workers.size() < count) {
+            size_t index = workers.size();
+            uint64_t current = generation;
+            workers.emplace_back([this, index, current] { WorkerLoop(index, current); });
+        }
+    }
+
+    void WorkerLoop(size_t index, uint64_t seen) {
+        while (true) {
+            {
+                unique_lock<mutex> lock(stateMutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+                if (index >= jobWorkers) {
+                    continue;
+                }
+            }
+            Work();
+            {
+                lock_guard<mutex> lock(stateMutex);
+                --activeWorkers;
+            }
+            done.notify_all();
+        }
+    }
+
+    // Задачи разобраны, когда вызывающий поток вышел из Work, а activeWorkers обнулился.
+    // После исключения оставшиеся задачи не выдаются, чтобы вызов завершился быстрее
+    void Work() {
+        try {
+            for (size_t i = nextTask++; i < jobSize; i = nextTask++) {
+                (*job)(i);
+            }
+        } catch (...) {
+            nextTask = jobSize;
+            lock_guard<mutex> lock(stateMutex);
+            if (!failure) {
+                failure = current_exception();
+            }
+        }
+    }
+
+    vector<thread> workers;
+    mutex runMutex;
+    mutex stateMutex;
+    condition_variable wake;
+    condition_variable done;
+    const function<void(size_t)>* job = nullptr;
+    size_t jobSize = 0;
+    atomic<size_t> nextTask{0};
+    exception_ptr failure;
+    size_t jobWorkers = 0;
+    size_t activeWorkers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+static ThreadPool& Pool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ParallelFor(size_t taskCount, const function<void(size_t)>& task) {
+    unsigned threads = GetThreadCount();
+    if (threads > 1 && taskCount > 1 && Pool().TryRun(taskCount, threads, task)) {
+        return;
+    }
+    for (size_t i = 0; i < taskCount; ++i) {
+        task(i);
+    }
+}
+
+void ParallelTransform(const uint8_t* src, uint8_t* dst, size_t length, size_t blockSize, const BlockTransform& transform) {
+    StatTimer timer(Stat::TRANSFORM_NS, length);
+    CountStat(Stat::BLOCKS, length / blockSize);
+    unsigned threads = GetThreadCount();
+    if (threads <= 1 || length < 2 * MIN_PARALLEL_PART) {
+        transform(src, dst, length);
+        return;
+    }
+
+    // Частей в несколько раз больше, чем потоков, чтобы неравномерность сглаживалась
+    size_t blocks = length / blockSize;
+    size_t parts = min<size_t>(threads * 4, max<size_t>(1, length / MIN_PARALLEL_PART));
+    size_t blocksPerPart = (blocks + parts - 1) / parts;
+    size_t partLength = blocksPerPart * blockSize;
+    parts = (length + partLength - 1) / partLength;
+
+    auto task = [&](size_t part) {
+        size_t begin = part * partLength;
+        size_t size = min(partLength, length - begin);
+        transform(src + begin, dst + begin, size);
+    };
+    // Ссылка помещается в function без выделения памяти, в отличие от самой лямбды
+    ParallelFor(parts, ref(task));
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "blockio.h"
+
+// Количество потоков поблочной обработки (по умолчанию 1); 0 - по числу ядер
+void SetThreadCount(unsigned count);
+unsigned GetThreadCount();
+
+// Выполняет task(0) ... task(taskCount - 1) в пуле потоков; вызывающий поток тоже участвует
+void ParallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+
+// Делит [0, length) на части, выровненные по blockSize, и применяет transform к ним параллельно.
+// Результат совпадает с последовательным вызовом transform(src, dst, length)
+void ParallelTransform(const uint8_t* src, uint8_t* dst, size_t length, size_t blockSize, const BlockTransform& transform);
@@ -1,4 +1,12 @@
 #include "permutation.h"
+#include "blockio.h"
+#include "parallel.h"
+#include "uringio.h"
+#include "stats.h"
+#include "trace.h"
+#include "textblock.h"
+#include "gatherkernel.h"
+#include "vectorgather.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -8,33 +16,13 @@
 #include <random>
 #include <ctime>
 #include <stdexcept>
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <utility>
 
 using namespace std;
 
-vector<string> SplitUTF8(const string& str) {
-    vector<string> characters;
-    
-    for (size_t i = 0; i < str.length();) {
-        unsigned char c = str[i];
-        size_t charLen = 1;
-        
-        if ((c & 0x80) == 0) {
-            charLen = 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            charLen = 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            charLen = 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            charLen = 4;
-        }
-        
-        characters.push_back(str.substr(i, charLen));
-        i += charLen;
-    }
-    
-    return characters;
-}
-
 vector<size_t> ParseKey(const string& key) {
     vector<size_t> permutation;
     stringstream ss(key);
@@ -86,164 +74,294 @@ string GeneratePermutationKey() {
     return keyStream.str();
 }
 
-vector<uint8_t> ProcessBinaryData(const vector<uint8_t>& data, const vector<size_t>& permutation, bool encrypt) {
+// Таблица выборки: processedBlock[i] = block[gather[i]]
+vector<uint8_t> BuildGatherTable(const vector<size_t>& permutation, bool encrypt) {
     size_t blockSize = permutation.size();
-    if (data.empty() || blockSize == 0) {
-        return vector<uint8_t>();
+    vector<uint8_t> gather;
+    if (blockSize > 256) {
+        return gather;
     }
-    
-    vector<size_t> currentPermutation(blockSize);
+    gather.resize(blockSize);
+    for (size_t j = 0; j < blockSize; ++j) {
+        if (encrypt) {
+            gather[permutation[j]] = static_cast<uint8_t>(j);
+        } else {
+            gather[j] = static_cast<uint8_t>(permutation[j]);
+        }
+    }
+    return gather;
+}
+
+// Поблочная выборка для длины ключа Length, известной при компиляции: ключи из
+// GeneratePermutationKey имеют длину от 3 до 8, для них цикл по блоку разворачивается
+const size_t MAX_FIXED_PERMUTATION = 8;
+
+using PermutationKernel = void (*)(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather);
+
+template <size_t Length>
+void PermuteBlocksFixed(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather) {
+    GatherFixed<Length>(src, dst, length, gather);
+}
+
+template <size_t... Offsets>
+constexpr array<PermutationKernel, sizeof...(Offsets)> MakePermutationKernels(index_sequence<Offsets...>) {
+    return {{PermuteBlocksFixed<Offsets + 1>...}};
+}
+
+constexpr auto permutationKernels = MakePermutationKernels(make_index_sequence<MAX_FIXED_PERMUTATION>());
+
+// Таблицы одного направления: scatter для поблочного цикла, gather для векторного ядра
+// и ядра с постоянной длиной блока (fixed, если длина не больше MAX_FIXED_PERMUTATION)
+struct PermutationTables {
+    vector<size_t> scatter;
+    vector<uint8_t> gather;
+    PermutationKernel fixed = nullptr;
+};
+
+PermutationTables BuildPermutationTables(const vector<size_t>& permutation, bool encrypt) {
+    size_t blockSize = permutation.size();
+    TraceSpan span("table_build", blockSize);
+    PermutationTables tables;
+    tables.scatter.resize(blockSize);
     if (encrypt) {
-        currentPermutation = permutation;
+        tables.scatter = permutation;
     } else {
         for (size_t i = 0; i < blockSize; ++i) {
-            currentPermutation[permutation[i]] = i;
+            tables.scatter[permutation[i]] = i;
         }
     }
-    
-    vector<uint8_t> result;
-    result.reserve(data.size() + blockSize);
-    
-    for (size_t i = 0; i < data.size(); i += blockSize) {
-        size_t currentBlockSize = min(blockSize, data.size() - i);
-        
-        vector<uint8_t> block(blockSize, 0);
-        for (size_t j = 0; j < currentBlockSize; ++j) {
-            block[j] = data[i + j];
-        }
-        
-        vector<uint8_t> processedBlock(blockSize);
-        for (size_t j = 0; j < blockSize; ++j) {
-            processedBlock[currentPermutation[j]] = block[j];
-        }
-        
-        result.insert(result.end(), processedBlock.begin(), processedBlock.end());
+    tables.gather = BuildGatherTable(permutation, encrypt);
+    if (blockSize >= 1 && blockSize <= MAX_FIXED_PERMUTATION) {
+        tables.fixed = permutationKernels[blockSize - 1];
+    }
+    return tables;
+}
+
+// Перестановка целых блоков: length кратно размеру блока
+void PermuteBlocks(const uint8_t* src, uint8_t* dst, size_t length, const PermutationTables& tables) {
+    size_t blockSize = tables.scatter.size();
+    size_t i = 0;
+    if (!tables.gather.empty()) {
+        i = GatherBlocksVector(src, dst, length, tables.gather.data(), tables.gather.size());
+    }
+    if (tables.fixed) {
+        tables.fixed(src + i, dst + i, length - i, tables.gather.data());
+        return;
     }
     
-    if (!encrypt) {
-        while (!result.empty() && result.back() == 0) {
-            result.pop_back();
+    for (; i < length; i += blockSize) {
+        for (size_t j = 0; j < blockSize; ++j) {
+            dst[i + tables.scatter[j]] = src[i + j];
         }
     }
-    
-    return result;
 }
 
-string PermutationTextEncrypt(const string& text, const string& key) {
-    vector<size_t> permutation = ParseKey(key);
-    
+// Таблицы обоих направлений ключа. Разброс одного направления - это выборка другого:
+// при шифровании символ i блока берётся из позиции decrypt.scatter[i], поэтому текст
+// в UTF-8 переставляется теми же векторами, что и байты
+struct PermutationKeyTables {
+    PermutationTables encrypt;
+    PermutationTables decrypt;
+};
+
+shared_ptr<const PermutationKeyTables> BuildPermutationKeyTables(const vector<size_t>& permutation) {
+    auto tables = make_shared<PermutationKeyTables>();
+    tables->encrypt = BuildPermutationTables(permutation, true);
+    tables->decrypt = BuildPermutationTables(permutation, false);
+    return tables;
+}
+
+BlockCipher MakePermutationCipher(const shared_ptr<const PermutationKeyTables>& tables) {
+    BlockCipher cipher;
+    cipher.blockSize = tables->encrypt.scatter.size();
+    cipher.encrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        PermuteBlocks(src, dst, length, tables->encrypt);
+    };
+    cipher.decrypt = [tables](const uint8_t* src, uint8_t* dst, size_t length) {
+        PermuteBlocks(src, dst, length, tables->decrypt);
+    };
+    cipher.padEmpty = false;
+    cipher.cipherId = CipherId::PERMUTATION;
+    cipher.keyParam = static_cast<uint32_t>(cipher.blockSize);
+    return cipher;
+}
+
+void PermutationSetChunkSize(size_t bytes) {
+    SetStreamChunkSize(bytes);
+}
+
+void PermutationSetIoBackend(const string& name) {
+    SetIoBackend(name);
+}
+
+void PermutationSetThreadCount(unsigned count) {
+    SetThreadCount(count);
+}
+
+AsyncIoStats PermutationGetAsyncIoStats() {
+    return GetAsyncIoStats();
+}
+
+CipherStats PermutationGetStats() {
+    return GetCipherStats();
+}
+
+void PermutationResetStats() {
+    ResetCipherStats();
+}
+
+void PermutationSetStatsEnabled(bool enabled) {
+    SetStatsEnabled(enabled);
+}
+
+// Таблицы ключа, построенные один раз: при шифровании многих сообщений одним ключом
+// остаётся только само преобразование
+struct PermutationContext {
+    shared_ptr<const PermutationKeyTables> tables;
+    BlockCipher cipher; // файловые ядра ключа на тех же таблицах: ими же переставляются данные в памяти
+};
+
+PermutationContext* PermutationCreateContext(const string& key) {
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    auto context = make_unique<PermutationContext>();
+    context->tables = BuildPermutationKeyTables(ParseKey(key));
+    context->cipher = MakePermutationCipher(context->tables);
+    return context.release();
+}
+
+void PermutationDestroyContext(PermutationContext* context) {
+    delete context;
+}
+
+string PermuteAsciiText(const string& text, const PermutationTables& tables, bool trimSpaces) {
+    size_t blockSize = tables.scatter.size();
+    return TransformAsciiText(text, blockSize, trimSpaces, [&](const char* src, char* dst, size_t length) {
+        ParallelTransform(reinterpret_cast<const uint8_t*>(src), reinterpret_cast<uint8_t*>(dst), length, blockSize,
+                          [&tables](const uint8_t* in, uint8_t* out, size_t part) {
+            PermuteBlocks(in, out, part, tables);
+        });
+    });
+}
+
+string PermutationEncryptWithContext(const PermutationContext* context, const string& text) {
+    CountStat(Stat::CALLS);
     if (text.empty()) {
         return "";
     }
     
-    vector<string> characters = SplitUTF8(text);
-    string result;
-    
-    size_t blockSize = permutation.size();
-    
-    for (size_t i = 0; i < characters.size(); i += blockSize) {
-        size_t currentBlockSize = min(blockSize, characters.size() - i);
-        
-        vector<string> block;
-        for (size_t j = 0; j < currentBlockSize; ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        while (block.size() < blockSize) {
-            block.push_back(" ");
-        }
-        
-        vector<string> encryptedBlock(blockSize);
-        for (size_t j = 0; j < blockSize; ++j) {
-            encryptedBlock[permutation[j]] = block[j];
-        }
-        
-        for (const auto& ch : encryptedBlock) {
-            result += ch;
-        }
+    if (IsAscii(text.data(), text.size())) {
+        return PermuteAsciiText(text, context->tables->encrypt, false);
     }
-    
-    return result;
+    return GatherText(text, context->tables->decrypt.scatter, false);
 }
 
-string PermutationTextDecrypt(const string& encryptedText, const string& key) {
-    vector<size_t> permutation = ParseKey(key);
-    
+string PermutationDecryptWithContext(const PermutationContext* context, const string& encryptedText) {
+    CountStat(Stat::CALLS);
     if (encryptedText.empty()) {
         return "";
     }
     
-    vector<string> characters = SplitUTF8(encryptedText);
-    
-    size_t blockSize = permutation.size();
-    vector<size_t> inverse(blockSize);
-    for (size_t i = 0; i < blockSize; ++i) {
-        inverse[permutation[i]] = i;
-    }
-    
-    string result;
-    
-    for (size_t i = 0; i < characters.size(); i += blockSize) {
-        vector<string> block;
-        for (size_t j = 0; j < blockSize && (i + j) < characters.size(); ++j) {
-            block.push_back(characters[i + j]);
-        }
-        
-        vector<string> decryptedBlock(blockSize);
-        for (size_t j = 0; j < blockSize; ++j) {
-            decryptedBlock[inverse[j]] = block[j];
-        }
-        
-        for (const auto& ch : decryptedBlock) {
-            result += ch;
-        }
-    }
-    
-    while (!result.empty() && result.back() == ' ') {
-        result.pop_back();
+    if (IsAscii(encryptedText.data(), encryptedText.size())) {
+        return PermuteAsciiText(encryptedText, context->tables->decrypt, true);
     }
-    
-    return result;
+    return GatherText(encryptedText, context->tables->encrypt.scatter, true);
+}
+
+string PermutationTextEncrypt(const string& text, const string& key) {
+    unique_ptr<PermutationContext> context(PermutationCreateContext(key));
+    return PermutationEncryptWithContext(context.get(), text);
+}
+
+string PermutationTextDecrypt(const string& encryptedText, const string& key) {
+    unique_ptr<PermutationContext> context(PermutationCreateContext(key));
+    return PermutationDecryptWithContext(context.get(), encryptedText);
+}
+
+// Шифр для ключа файловой операции: учитывается вызов и время разбора ключа
+BlockCipher PermutationCipherForKey(const string& key) {
+    CountStat(Stat::CALLS);
+    StatTimer timer(Stat::KEY_SETUP_NS);
+    return MakePermutationCipher(BuildPermutationKeyTables(ParseKey(key)));
 }
 
 void PermutationFileEncrypt(const string& inPath, const string& outPath, const string& key) {
-    vector<size_t> permutation = ParseKey(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto encrypted = ProcessBinaryData(content, permutation, true);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
-    }
-    outputFile.write(reinterpret_cast<const char*>(encrypted.data()), encrypted.size());
-    outputFile.close();
+    EncryptFile(inPath, outPath, PermutationCipherForKey(key));
+}
+
+void PermutationFileEncryptFramed(const string& inPath, const string& outPath, const string& key) {
+    StreamEncryptFileFramed(inPath, outPath, PermutationCipherForKey(key));
 }
 
 void PermutationFileDecrypt(const string& inPath, const string& outPath, const string& key) {
+    DecryptFile(inPath, outPath, PermutationCipherForKey(key));
+}
+
+void PermutationStreamEncrypt(int inFd, int outFd, const string& key) {
+    StreamEncryptDescriptor(inFd, outFd, PermutationCipherForKey(key));
+}
+
+void PermutationStreamDecrypt(int inFd, int outFd, const string& key) {
+    StreamDecryptDescriptor(inFd, outFd, PermutationCipherForKey(key));
+}
+
+size_t PermutationDecryptRange(const string& inPath, const string& key, uint64_t offset, uint64_t length, uint8_t* out) {
+    return DecryptFileRange(inPath, PermutationCipherForKey(key), offset, length, out);
+}
+
+size_t PermutationEncryptInPlace(const PermutationContext* context, uint8_t* buffer, size_t length, size_t capacity) {
+    CountStat(Stat::CALLS);
+    return EncryptBuffer(buffer, length, capacity, context->cipher);
+}
+
+size_t PermutationDecryptInPlace(const PermutationContext* context, uint8_t* buffer, size_t length) {
+    CountStat(Stat::CALLS);
+    return DecryptBuffer(buffer, length, context->cipher);
+}
+
+size_t PermutationBufferBound(const PermutationContext* context, size_t length) {
+    return EncryptedBufferSize(length, context->cipher);
+}
+
+vector<uint32_t> PermutationEncryptTable(const string& key) {
     vector<size_t> permutation = ParseKey(key);
-    
-    ifstream inputFile(inPath, ios::binary);
-    if (!inputFile) {
-        throw runtime_error("Не удалось открыть входной файл: " + inPath);
-    }
-    
-    vector<uint8_t> content((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-    inputFile.close();
-    
-    auto decrypted = ProcessBinaryData(content, permutation, false);
-    
-    ofstream outputFile(outPath, ios::binary);
-    if (!outputFile) {
-        throw runtime_error("Не удалось создать выходной файл: " + outPath);
+    vector<uint32_t> table(permutation.size());
+    for (size_t j = 0; j < permutation.size(); ++j) {
+        table[permutation[j]] = static_cast<uint32_t>(j);
     }
-    outputFile.write(reinterpret_cast<const char*>(decrypted.data()), decrypted.size());
-    outputFile.close();
+    return table;
+}
+
+size_t PermutationTextEncryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                   char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<PermutationContext> context(PermutationCreateContext(key));
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, false, [&](size_t) -> const vector<size_t>& {
+        return context->tables->decrypt.scatter;
+    });
+}
+
+size_t PermutationTextDecryptBatch(const string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                   char* out, size_t capacity, size_t* offsets) {
+    CountStat(Stat::CALLS);
+    unique_ptr<PermutationContext> context(PermutationCreateContext(key));
+    return GatherTextBatch(inputs, lengths, count, out, capacity, offsets, true, [&](size_t) -> const vector<size_t>& {
+        return context->tables->encrypt.scatter;
+    });
+}
+
+size_t PermutationTextBatchBound(const string& key, const size_t* lengths, size_t count) {
+    return GatherTextBatchBound(lengths, count, ParseKey(key).size());
+}
+
+const CipherPlugin* CipherPluginDescriptor() {
+    static const CipherPlugin plugin = {
+        CIPHER_PLUGIN_VERSION, 1, "permutation", "Перестановка", "ШИФР ПЕРЕСТАНОВКИ", "шифра перестановки",
+        PermutationTextEncrypt, PermutationTextDecrypt,
+        PermutationFileEncrypt, PermutationFileDecrypt, PermutationFileEncryptFramed, PermutationDecryptRange,
+        PermutationStreamEncrypt, PermutationStreamDecrypt,
+        GeneratePermutationKey, PermutationSetChunkSize, PermutationSetIoBackend, PermutationSetThreadCount,
+        PermutationGetAsyncIoStats, PermutationGetStats, PermutationResetStats, PermutationSetStatsEnabled,
+        PermutationEncryptTable
+    };
+    return &plugin;
 }
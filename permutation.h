@@ -1,12 +1,68 @@
 #pragma once
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "plugin.h"
 
 #define PERMUTATION_API
 
+// Разобранный ключ с готовыми таблицами прямого и обратного преобразования
+struct PermutationContext;
+
 extern "C" {
     PERMUTATION_API std::string PermutationTextEncrypt(const std::string& text, const std::string& key);
     PERMUTATION_API std::string PermutationTextDecrypt(const std::string& text, const std::string& key);
+    // Контекст создаётся один раз на ключ и используется для любого числа сообщений
+    PERMUTATION_API PermutationContext* PermutationCreateContext(const std::string& key);
+    PERMUTATION_API std::string PermutationEncryptWithContext(const PermutationContext* context, const std::string& text);
+    PERMUTATION_API std::string PermutationDecryptWithContext(const PermutationContext* context, const std::string& text);
+    PERMUTATION_API void PermutationDestroyContext(PermutationContext* context);
+    // Пакетная обработка count сообщений одним ключом: результат сообщения i записывается
+    // в out[offsets[i], offsets[i + 1]), в offsets count + 1 элементов. Возвращает общий размер;
+    // достаточный размер out даёт TextBatchBound, при нехватке бросается length_error
+    PERMUTATION_API size_t PermutationTextEncryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    PERMUTATION_API size_t PermutationTextDecryptBatch(const std::string& key, const char* const* inputs, const size_t* lengths, size_t count,
+                                    char* out, size_t capacity, size_t* offsets);
+    PERMUTATION_API size_t PermutationTextBatchBound(const std::string& key, const size_t* lengths, size_t count);
     PERMUTATION_API void PermutationFileEncrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Шифрование в контейнер с заголовком, хранящим исходную длину; FileDecrypt распознаёт его сам
+    PERMUTATION_API void PermutationFileEncryptFramed(const std::string& inPath, const std::string& outPath, const std::string& key);
     PERMUTATION_API void PermutationFileDecrypt(const std::string& inPath, const std::string& outPath, const std::string& key);
+    // Потоковая обработка открытых дескрипторов (каналов, stdin/stdout); дескрипторы не закрываются
+    PERMUTATION_API void PermutationStreamEncrypt(int inFd, int outFd, const std::string& key);
+    PERMUTATION_API void PermutationStreamDecrypt(int inFd, int outFd, const std::string& key);
+    // Расшифрование байт [offset, offset + length) исходного файла с чтением только нужных блоков;
+    // возвращает количество записанных в out байт
+    PERMUTATION_API size_t PermutationDecryptRange(const std::string& inPath, const std::string& key, uint64_t offset, uint64_t length, uint8_t* out);
+    // Шифрование данных в памяти на месте, без выделения памяти: buffer[0, length) дополняется
+    // нулями до целого блока и переставляется внутри buffer. Вызывающий может сразу выделить
+    // PermutationBufferBound байт; при меньшем capacity бросается length_error. Возвращает длину результата
+    PERMUTATION_API size_t PermutationEncryptInPlace(const PermutationContext* context, uint8_t* buffer, size_t length, size_t capacity);
+    // Расшифрование на месте; length кратна размеру блока. Возвращает длину данных без нулей
+    // в конце, как при расшифровании файла без заголовка
+    PERMUTATION_API size_t PermutationDecryptInPlace(const PermutationContext* context, uint8_t* buffer, size_t length);
+    // Размер буфера для шифрования length байт на месте
+    PERMUTATION_API size_t PermutationBufferBound(const PermutationContext* context, size_t length);
     PERMUTATION_API std::string GeneratePermutationKey();
+    // Размер порции потоковой обработки файлов (по умолчанию 4 МБ); 0 - обработка файла целиком
+    PERMUTATION_API void PermutationSetChunkSize(size_t bytes);
+    // Механизм файлового ввода-вывода: "stream" (по умолчанию), "whole", "mmap", "mmap-huge",
+    // "uring" или "uring:N" - асинхронный ввод-вывод с глубиной очереди N
+    PERMUTATION_API void PermutationSetIoBackend(const std::string& name);
+    // Количество потоков поблочной обработки (по умолчанию 1); 0 - по числу ядер
+    PERMUTATION_API void PermutationSetThreadCount(unsigned count);
+    // Статистика очереди механизма "uring" для последней файловой операции этого потока
+    PERMUTATION_API AsyncIoStats PermutationGetAsyncIoStats();
+    // Счётчики вызовов, объёмов и времени по фазам, сумма по всем потокам; сбор включается
+    // SetStatsEnabled или переменной окружения CRYPTOGRAPHY_STATS
+    PERMUTATION_API CipherStats PermutationGetStats();
+    PERMUTATION_API void PermutationResetStats();
+    PERMUTATION_API void PermutationSetStatsEnabled(bool enabled);
+    // Таблица выборки файлового шифрования одного блока для ключа: байт k зашифрованного
+    // блока берётся из позиции table[k]; по ней каскад шифров составляет общую перестановку
+    PERMUTATION_API std::vector<uint32_t> PermutationEncryptTable(const std::string& key);
+    // Описание шифра для реестра библиотек программы
+    PERMUTATION_API const CipherPlugin* CipherPluginDescriptor();
 }
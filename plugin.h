@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Описание библиотеки шифра для программы: названия для меню и таблица функций.
+// Каждая библиотека экспортирует CipherPluginDescriptor, возвращающую указатель
+// на статическое описание; программа находит библиотеки в каталоге сама
+const uint32_t CIPHER_PLUGIN_VERSION = 6;
+const char* const CIPHER_PLUGIN_ENTRY = "CipherPluginDescriptor";
+
+// Статистика асинхронного ввода-вывода (механизм "uring") последней файловой операции
+// вызывающего потока: насколько полно удалось загрузить очередь запросов
+struct AsyncIoStats {
+    uint32_t queueDepth;    // заданная глубина очереди
+    uint32_t maxInFlight;   // наибольшее число одновременных запросов
+    double averageInFlight; // среднее число запросов в обработке
+    uint64_t requests;      // всего запросов чтения и записи
+    bool fallback;          // io_uring недоступен: работали потоки с pread/pwrite
+};
+
+// Счётчики библиотеки с загрузки или последнего сброса, сумма по всем потокам. Собираются,
+// только пока включён сбор (setStatsEnabled или переменная CRYPTOGRAPHY_STATS); время - в наносекундах.
+// При отображении файлов в память чтение и запись происходят внутри преобразования
+struct CipherStats {
+    uint64_t calls;           // вызовы шифрования и расшифрования
+    uint64_t bytesIn;         // прочитано из файлов и получено в тексте
+    uint64_t bytesOut;        // записано в файлы и возвращено в тексте
+    uint64_t blocks;          // преобразованных блоков
+    uint64_t paddingAdded;    // байт дополнения последнего блока при шифровании
+    uint64_t paddingStripped; // байт дополнения, отброшенных при расшифровании
+    uint64_t allocations;     // выделенных буферов данных и результатов
+    uint64_t allocatedBytes;
+    uint64_t keySetupNs;      // разбор ключа и построение таблиц
+    uint64_t readNs;          // системные вызовы чтения
+    uint64_t transformNs;     // преобразование блоков
+    uint64_t writeNs;         // системные вызовы записи
+    uint64_t waitNs;          // ожидание вызывающим потоком фоновых чтения и записи
+};
+
+using PluginTextFunc = std::string (*)(const std::string& text, const std::string& key);
+using PluginFileFunc = void (*)(const std::string& inPath, const std::string& outPath, const std::string& key);
+using PluginRangeFunc = size_t (*)(const std::string& inPath, const std::string& key, uint64_t offset, uint64_t length, uint8_t* out);
+using PluginStreamFunc = void (*)(int inFd, int outFd, const std::string& key);
+using PluginKeyFunc = std::string (*)();
+using PluginTableFunc = std::vector<uint32_t> (*)(const std::string& key);
+
+struct CipherPlugin {
+    uint32_t version;          // CIPHER_PLUGIN_VERSION, с которой собрана библиотека
+    int menuOrder;             // место в меню: шифры сортируются по возрастанию
+    const char* name;          // короткое имя: "permutation", "matrix", ...
+    const char* displayName;   // пункт меню: "Перестановка"
+    const char* menuTitle;     // заголовок меню шифра: "ШИФР ПЕРЕСТАНОВКИ"
+    const char* keyPrompt;     // для приглашения "Введите ключ для ...": "шифра перестановки"
+    PluginTextFunc textEncrypt;
+    PluginTextFunc textDecrypt;
+    PluginFileFunc fileEncrypt;
+    PluginFileFunc fileDecrypt;
+    PluginFileFunc fileEncryptFramed;
+    PluginRangeFunc decryptRange;
+    PluginStreamFunc streamEncrypt;
+    PluginStreamFunc streamDecrypt;
+    PluginKeyFunc generateKey;
+    void (*setChunkSize)(size_t bytes);
+    void (*setIoBackend)(const std::string& name);
+    void (*setThreadCount)(unsigned count);
+    AsyncIoStats (*getAsyncIoStats)();
+    CipherStats (*getStats)();
+    void (*resetStats)();
+    void (*setStatsEnabled)(bool enabled);
+    // Таблица выборки файлового шифрования одного блока: байт k зашифрованного блока берётся
+    // из позиции table[k] исходного, размер таблицы - размер блока. По ней каскад шифров
+    // составляет одну перестановку из нескольких
+    PluginTableFunc encryptTable;
+};
+
+using PluginDescriptorFunc = const CipherPlugin* (*)();
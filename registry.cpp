@@ -0,0 +1,97 @@
+#include "registry.h"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <dlfcn.h>
+
+using namespace std;
+
+CipherRegistry::~CipherRegistry() {
+    for (auto& cipher : ciphers) {
+        dlclose(cipher.handle);
+    }
+}
+
+// Проверка, что описание полное и собрано с той же версией
+static void ValidatePlugin(const CipherPlugin* plugin, const string& path) {
+    if (!plugin) {
+        throw runtime_error("Библиотека не вернула описание шифра: " + path);
+    }
+    if (plugin->version != CIPHER_PLUGIN_VERSION) {
+        throw runtime_error("Несовместимая версия описания шифра (" + to_string(plugin->version) + "): " + path);
+    }
+    if (!plugin->name || !plugin->displayName || !plugin->menuTitle || !plugin->keyPrompt ||
+        !plugin->textEncrypt || !plugin->textDecrypt || !plugin->fileEncrypt || !plugin->fileDecrypt ||
+        !plugin->fileEncryptFramed || !plugin->decryptRange || !plugin->streamEncrypt || !plugin->streamDecrypt ||
+        !plugin->generateKey || !plugin->setChunkSize || !plugin->setIoBackend || !plugin->setThreadCount ||
+        !plugin->getAsyncIoStats || !plugin->getStats || !plugin->resetStats || !plugin->setStatsEnabled ||
+        !plugin->encryptTable) {
+        throw runtime_error("Описание шифра заполнено не полностью: " + path);
+    }
+}
+
+const CipherPlugin& CipherRegistry::Load(const string& path) {
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        const char* error = dlerror();
+        throw runtime_error("Не удалось загрузить библиотеку " + path + (error ? string(": ") + error : string()));
+    }
+
+    const CipherPlugin* plugin = nullptr;
+    try {
+        auto descriptor = reinterpret_cast<PluginDescriptorFunc>(dlsym(handle, CIPHER_PLUGIN_ENTRY));
+        if (!descriptor) {
+            throw runtime_error("В библиотеке нет функции " + string(CIPHER_PLUGIN_ENTRY) + ": " + path);
+        }
+        plugin = descriptor();
+        ValidatePlugin(plugin, path);
+        if (Find(plugin->name)) {
+            throw runtime_error("Шифр " + string(plugin->name) + " уже загружен, повтор в " + path);
+        }
+    } catch (...) {
+        dlclose(handle);
+        throw;
+    }
+
+    LoadedCipher cipher = {path, handle, plugin};
+    auto position = upper_bound(ciphers.begin(), ciphers.end(), cipher, [](const LoadedCipher& a, const LoadedCipher& b) {
+        return a.plugin->menuOrder < b.plugin->menuOrder;
+    });
+    return *ciphers.insert(position, cipher)->plugin;
+}
+
+void CipherRegistry::LoadDirectory(const string& directory, vector<string>& errors) {
+    namespace fs = std::filesystem;
+
+    vector<string> paths;
+    error_code code;
+    for (fs::directory_iterator it(directory, code), end; !code && it != end; it.increment(code)) {
+        string fileName = it->path().filename().string();
+        if (fileName.compare(0, 3, "lib") == 0 && it->path().extension() == ".so") {
+            paths.push_back(it->path().string());
+        }
+    }
+    if (code) {
+        errors.push_back("Не удалось прочитать каталог " + directory + ": " + code.message());
+        return;
+    }
+
+    // Порядок обхода каталога не определён, а от него зависит, какой из одноимённых шифров загрузится
+    sort(paths.begin(), paths.end());
+    for (const auto& path : paths) {
+        try {
+            Load(path);
+        } catch (const exception& e) {
+            errors.push_back(e.what());
+        }
+    }
+}
+
+const CipherPlugin* CipherRegistry::Find(const string& name) const {
+    for (const auto& cipher : ciphers) {
+        if (name == cipher.plugin->name) {
+            return cipher.plugin;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "plugin.h"
+
+// Каталог, в котором программа ищет библиотеки шифров
+const char* const DEFAULT_LIB_DIRECTORY = "./build/lib";
+
+// Загруженная библиотека шифра: остаётся в памяти до завершения программы
+struct LoadedCipher {
+    std::string path;
+    void* handle;
+    const CipherPlugin* plugin;
+};
+
+// Реестр библиотек шифров. Каждая библиотека открывается один раз с RTLD_NOW,
+// так что все её символы связываются при загрузке, а не при первом вызове
+class CipherRegistry {
+public:
+    CipherRegistry() = default;
+    CipherRegistry(const CipherRegistry&) = delete;
+    CipherRegistry& operator=(const CipherRegistry&) = delete;
+    ~CipherRegistry();
+
+    // Загружает все библиотеки lib*.so из каталога, у которых есть описание шифра.
+    // Неподходящие библиотеки пропускаются, причины попадают в errors
+    void LoadDirectory(const std::string& directory, std::vector<std::string>& errors);
+
+    // Загружает одну библиотеку; при ошибке бросает runtime_error
+    const CipherPlugin& Load(const std::string& path);
+
+    // Шифры в порядке menuOrder
+    const std::vector<LoadedCipher>& Ciphers() const { return ciphers; }
+
+    // Шифр по короткому имени или nullptr
+    const CipherPlugin* Find(const std::string& name) const;
+
+private:
+    std::vector<LoadedCipher> ciphers;
+};
@@ -0,0 +1,588 @@
+// Проверки библиотек шифров: шифрование файлов с заголовком и без него всеми механизмами
+// ввода-вывода, отказ на повреждённом заголовке, расшифрование диапазонов, шифрование
+// в памяти на месте, отказ на некорректном UTF-8 и совпадение результатов всех вариантов
+// векторных ядер, доступных процессору, со скалярным.
+// Запуск: make test
+#include "registry.h"
+#include "cpudispatch.h"
+#include <dlfcn.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Ключи проверки: небольшой блок и блок больше порции, чтобы граница порций проходила внутри блока
+struct TestKey {
+    const char* cipher;
+    const char* key;
+    // Другой ключ с тем же размером блока, который заголовок контейнера должен отличить
+    const char* otherKey;
+};
+
+const TestKey TEST_KEYS[] = {
+    {"permutation", "3-1-4-2", nullptr},
+    {"permutation", "5-3-1-4-2-8-6-7", nullptr},
+    {"matrix", "5", nullptr},
+    {"matrix", "300", nullptr},
+    {"magicsquare", "5", nullptr},
+    {"magicsquare", "6", nullptr},
+    {"cascade", "permutation:3-1-4-2,matrix:5,magicsquare:3", "permutation:2-1-4-3,matrix:5,magicsquare:3"},
+};
+
+const char* const IO_BACKENDS[] = {"stream", "whole", "mmap", "uring"};
+
+// Порция потоковой обработки меньше проверочных файлов: файл проходит несколькими порциями
+const size_t TEST_CHUNK_SIZE = 64 << 10;
+
+const size_t TEST_LENGTHS[] = {0, 1, 7, 100, 4095, (1 << 20) + 3};
+
+// Префикс экспортируемых функций библиотеки по короткому имени шифра
+const char* ExportPrefix(const string& name) {
+    if (name == "permutation") {
+        return "Permutation";
+    } else if (name == "matrix") {
+        return "Matrix";
+    } else if (name == "magicsquare") {
+        return "MagicSquare";
+    } else if (name == "cascade") {
+        return "Cascade";
+    }
+    return nullptr;
+}
+
+struct TestOptions {
+    string libDirectory = DEFAULT_LIB_DIRECTORY;
+    string workDirectory = "/tmp";
+    bool digests = false;
+};
+
+static int checks = 0;
+static int failures = 0;
+
+void Check(bool passed, const string& description) {
+    ++checks;
+    if (!passed) {
+        ++failures;
+        cerr << "ОШИБКА! " << description << endl;
+    }
+}
+
+// Проверка, что call бросает исключение
+void CheckThrows(const function<void()>& call, const string& description) {
+    try {
+        call();
+    } catch (const exception&) {
+        Check(true, description);
+        return;
+    }
+    Check(false, description + ": исключения нет");
+}
+
+string ReadFile(const string& path) {
+    ifstream file(path, ios::binary);
+    ostringstream data;
+    data << file.rdbuf();
+    return data.str();
+}
+
+void WriteFile(const string& path, const string& data) {
+    ofstream file(path, ios::binary);
+    file.write(data.data(), data.size());
+    if (!file) {
+        throw runtime_error("Не удалось записать файл: " + path);
+    }
+}
+
+// Случайные данные с ненулевым последним байтом: файл без заголовка теряет нули в конце
+string MakeData(size_t length, uint32_t seed) {
+    mt19937 random(seed);
+    string data(length, '\0');
+    for (char& c : data) {
+        c = static_cast<char>(random());
+    }
+    if (length > 0 && data.back() == 0) {
+        data.back() = 1;
+    }
+    return data;
+}
+
+string Describe(const TestKey& key, const string& what, size_t length) {
+    return string(key.cipher) + " " + key.key + ", " + what + ", " + to_string(length) + " байт";
+}
+
+// Шифрование и расшифрование файлов с заголовком и без него каждым механизмом
+void TestRoundTrips(const CipherPlugin& plugin, const TestKey& key, const string& dir) {
+    string in = dir + "/plain", encrypted = dir + "/encrypted", decrypted = dir + "/decrypted";
+    for (const char* backend : IO_BACKENDS) {
+        plugin.setIoBackend(backend);
+        for (size_t length : TEST_LENGTHS) {
+            string data = MakeData(length, static_cast<uint32_t>(length));
+            // Файл с заголовком сохраняет и нули в конце
+            string framedData = data + string(length % 3, '\0');
+            string what = string(backend);
+            try {
+                WriteFile(in, data);
+                plugin.fileEncrypt(in, encrypted, key.key);
+                plugin.fileDecrypt(encrypted, decrypted, key.key);
+                Check(ReadFile(decrypted) == data, Describe(key, what + ", без заголовка", length));
+
+                WriteFile(in, framedData);
+                plugin.fileEncryptFramed(in, encrypted, key.key);
+                plugin.fileDecrypt(encrypted, decrypted, key.key);
+                Check(ReadFile(decrypted) == framedData, Describe(key, what + ", с заголовком", framedData.size()));
+            } catch (const exception& e) {
+                Check(false, Describe(key, what, length) + ": " + e.what());
+            }
+        }
+    }
+    plugin.setIoBackend("stream");
+}
+
+// Файл без заголовка с длинной серией нулей в конце: длина ищется с конца через много блоков
+void TestTrailingZeros(const CipherPlugin& plugin, const TestKey& key, const string& dir) {
+    string in = dir + "/plain", encrypted = dir + "/encrypted", decrypted = dir + "/decrypted";
+    string data = "x" + string(300000, '\0');
+    WriteFile(in, data);
+    plugin.fileEncrypt(in, encrypted, key.key);
+    for (const char* backend : IO_BACKENDS) {
+        plugin.setIoBackend(backend);
+        try {
+            plugin.fileDecrypt(encrypted, decrypted, key.key);
+            Check(ReadFile(decrypted) == "x", Describe(key, string(backend) + ", нули в конце", data.size()));
+        } catch (const exception& e) {
+            Check(false, Describe(key, string(backend) + ", нули в конце", data.size()) + ": " + e.what());
+        }
+    }
+    plugin.setIoBackend("stream");
+    uint8_t out[2] = {0, 0};
+    Check(plugin.decryptRange(encrypted, key.key, 0, 2, out) == 1 && out[0] == 'x',
+          Describe(key, "диапазон, нули в конце", data.size()));
+}
+
+// Заголовок: длина исходных данных - байты 16..23
+const size_t FRAME_LENGTH_OFFSET = 16;
+
+void PutLength(string& file, uint64_t length) {
+    for (size_t i = 0; i < 8; ++i) {
+        file[FRAME_LENGTH_OFFSET + i] = static_cast<char>(length >> (8 * i));
+    }
+}
+
+// Повреждённый заголовок или усечённые данные должны давать ошибку, а не пустой
+// или обрезанный результат, при любом механизме и при расшифровании диапазона
+void TestCorruptedHeaders(const CipherPlugin& plugin, const TestKey& key, const string& dir) {
+    string in = dir + "/plain", encrypted = dir + "/encrypted", corrupted = dir + "/corrupted", decrypted = dir + "/decrypted";
+    string data = MakeData(5000, 1);
+    WriteFile(in, data);
+    plugin.fileEncryptFramed(in, encrypted, key.key);
+    string file = ReadFile(encrypted);
+    uint64_t dataSize = file.size() - 32;
+
+    vector<pair<string, string>> cases;
+    string damaged = file;
+    PutLength(damaged, UINT64_MAX);
+    cases.push_back({"длина 2^64 - 1", damaged});
+    damaged = file;
+    PutLength(damaged, dataSize + 1);
+    cases.push_back({"длина больше данных", damaged});
+    damaged = file;
+    damaged[12] ^= 0x01; // размер блока
+    cases.push_back({"другой размер блока", damaged});
+    cases.push_back({"усечённый последний блок", file.substr(0, file.size() - 1)});
+
+    for (const auto& damage : cases) {
+        WriteFile(corrupted, damage.second);
+        for (const char* backend : IO_BACKENDS) {
+            plugin.setIoBackend(backend);
+            CheckThrows([&] {
+                plugin.fileDecrypt(corrupted, decrypted, key.key);
+            }, Describe(key, string(backend) + ", " + damage.first, data.size()));
+        }
+        plugin.setIoBackend("stream");
+        if (damage.first != "усечённый последний блок") {
+            vector<uint8_t> out(data.size());
+            CheckThrows([&] {
+                plugin.decryptRange(corrupted, key.key, 0, data.size(), out.data());
+            }, Describe(key, "диапазон, " + damage.first, data.size()));
+        }
+    }
+
+    if (key.otherKey) {
+        CheckThrows([&] {
+            plugin.fileDecrypt(encrypted, decrypted, key.otherKey);
+        }, Describe(key, string("расшифрование ключом ") + key.otherKey, data.size()));
+    }
+}
+
+// Расшифрование диапазонов совпадает с соответствующим куском исходных данных
+void TestRanges(const CipherPlugin& plugin, const TestKey& key, const string& dir) {
+    string in = dir + "/plain", encrypted = dir + "/encrypted";
+    string data = MakeData(100003, 2);
+    WriteFile(in, data);
+    size_t length = data.size();
+    const uint64_t offsets[] = {0, 1, 4095, 4096, length / 2, length - 1, length, length + 10};
+    const uint64_t sizes[] = {0, 1, 17, 5000, length, UINT64_MAX};
+
+    for (bool framed : {false, true}) {
+        if (framed) {
+            plugin.fileEncryptFramed(in, encrypted, key.key);
+        } else {
+            plugin.fileEncrypt(in, encrypted, key.key);
+        }
+        for (uint64_t offset : offsets) {
+            for (uint64_t size : sizes) {
+                uint64_t available = offset < length ? length - offset : 0;
+                size_t expected = static_cast<size_t>(min(size, available));
+                vector<uint8_t> out(expected + 1, 0xEE);
+                string what = string(framed ? "с заголовком" : "без заголовка") + ", диапазон " + to_string(offset) + "+" +
+                              (size == UINT64_MAX ? string("всё") : to_string(size));
+                try {
+                    size_t written = plugin.decryptRange(encrypted, key.key, offset, size, out.data());
+                    Check(written == expected && (expected == 0 || memcmp(out.data(), data.data() + offset, expected) == 0) &&
+                              out[expected] == 0xEE,
+                          Describe(key, what, length));
+                } catch (const exception& e) {
+                    Check(false, Describe(key, what, length) + ": " + e.what());
+                }
+            }
+        }
+    }
+}
+
+// Функции шифрования в памяти на месте (есть не у всех библиотек каталога)
+struct InPlaceApi {
+    void* (*createContext)(const string& key);
+    void (*destroyContext)(void* context);
+    size_t (*encrypt)(const void* context, uint8_t* buffer, size_t length, size_t capacity);
+    size_t (*decrypt)(const void* context, uint8_t* buffer, size_t length);
+    size_t (*bound)(const void* context, size_t length);
+};
+
+bool LoadInPlaceApi(const LoadedCipher& loaded, InPlaceApi& api) {
+    const char* prefix = ExportPrefix(loaded.plugin->name);
+    if (!prefix) {
+        return false;
+    }
+    auto symbol = [&](const char* name) {
+        return dlsym(loaded.handle, (string(prefix) + name).c_str());
+    };
+    api.createContext = reinterpret_cast<void* (*)(const string&)>(symbol("CreateContext"));
+    api.destroyContext = reinterpret_cast<void (*)(void*)>(symbol("DestroyContext"));
+    api.encrypt = reinterpret_cast<size_t (*)(const void*, uint8_t*, size_t, size_t)>(symbol("EncryptInPlace"));
+    api.decrypt = reinterpret_cast<size_t (*)(const void*, uint8_t*, size_t)>(symbol("DecryptInPlace"));
+    api.bound = reinterpret_cast<size_t (*)(const void*, size_t)>(symbol("BufferBound"));
+    return api.createContext && api.destroyContext && api.encrypt && api.decrypt && api.bound;
+}
+
+// Шифрование на месте даёт те же байты, что шифрование файла без заголовка, и обращается
+void TestInPlace(const LoadedCipher& loaded, const TestKey& key, const string& dir) {
+    InPlaceApi api;
+    if (!LoadInPlaceApi(loaded, api)) {
+        Check(false, string(key.cipher) + ": нет функций шифрования на месте");
+        return;
+    }
+    const CipherPlugin& plugin = *loaded.plugin;
+    string in = dir + "/plain", encrypted = dir + "/encrypted";
+    void* context = api.createContext(key.key);
+
+    for (size_t length : TEST_LENGTHS) {
+        string data = MakeData(length, static_cast<uint32_t>(length) + 7);
+        try {
+            WriteFile(in, data);
+            plugin.fileEncrypt(in, encrypted, key.key);
+            string expected = ReadFile(encrypted);
+
+            size_t capacity = api.bound(context, length);
+            vector<uint8_t> buffer(capacity + 1, 0xEE);
+            memcpy(buffer.data(), data.data(), length);
+            size_t size = api.encrypt(context, buffer.data(), length, capacity);
+            Check(size == expected.size() && memcmp(buffer.data(), expected.data(), size) == 0 && buffer[capacity] == 0xEE,
+                  Describe(key, "на месте совпадает с файлом", length));
+            size = api.decrypt(context, buffer.data(), size);
+            Check(size == length && memcmp(buffer.data(), data.data(), length) == 0,
+                  Describe(key, "расшифрование на месте", length));
+            if (capacity > length) {
+                CheckThrows([&] {
+                    api.encrypt(context, buffer.data(), length, capacity - 1);
+                }, Describe(key, "на месте без места для дополнения", length));
+            }
+        } catch (const exception& e) {
+            Check(false, Describe(key, "на месте", length) + ": " + e.what());
+        }
+    }
+    api.destroyContext(context);
+}
+
+// Текст с некорректными последовательностями UTF-8 отклоняется, корректный обращается
+void TestUtf8(const CipherPlugin& plugin, const TestKey& key) {
+    const char* const invalid[] = {
+        "abc\xff",           // байт, которого нет в UTF-8
+        "\xd0",              // оборванная последовательность
+        "\xc0\xaf",          // избыточная запись '/'
+        "\xed\xa0\x80",      // суррогат
+        "\xf4\x90\x80\x80",  // больше U+10FFFF
+        "\xd0\xbf\x80",      // лишний байт продолжения
+    };
+    for (const char* text : invalid) {
+        CheckThrows([&] {
+            plugin.textEncrypt(text, key.key);
+        }, string(key.cipher) + " " + key.key + ", некорректный UTF-8 при шифровании");
+    }
+
+    // Текст длиннее квадрата 300x300: короткий текст матрица шифрует уменьшенным квадратом,
+    // а расшифровывает полным, и такой текст не обращается
+    string valid;
+    for (int i = 0; i < 2000; ++i) {
+        valid += "Привет, мир! Съешь же ещё этих мягких французских булок.";
+    }
+    try {
+        string encrypted = plugin.textEncrypt(valid, key.key);
+        Check(plugin.textDecrypt(encrypted, key.key) == valid, string(key.cipher) + " " + key.key + ", текст UTF-8");
+    } catch (const exception& e) {
+        Check(false, string(key.cipher) + " " + key.key + ", текст UTF-8: " + e.what());
+    }
+}
+
+string Fingerprint(const string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+// Свёртки результатов шифра, которые зависят от векторных ядер: перестановка файла в обе
+// стороны, текст ASCII и UTF-8 и позиция ошибки в некорректном UTF-8. По строке на случай
+vector<string> CipherDigests(const LoadedCipher& loaded, const TestKey& key, const string& dir) {
+    const CipherPlugin& plugin = *loaded.plugin;
+    string in = dir + "/plain", encrypted = dir + "/encrypted", decrypted = dir + "/decrypted";
+    string prefix = string(key.cipher) + " " + key.key + " ";
+    vector<string> digests;
+    auto record = [&](const string& name, const function<string()>& result) {
+        string value;
+        try {
+            value = Fingerprint(result());
+        } catch (const exception& e) {
+            value = e.what();
+        }
+        digests.push_back(prefix + name + " " + value);
+    };
+
+    for (size_t length : {size_t(100), size_t(4095), size_t((1 << 20) + 3)}) {
+        record("encrypt:" + to_string(length), [&] {
+            WriteFile(in, MakeData(length, static_cast<uint32_t>(length) + 11));
+            plugin.fileEncrypt(in, encrypted, key.key);
+            return ReadFile(encrypted);
+        });
+    }
+    // Случайные данные целыми блоками как шифртекст: расшифрование не обращает шифрование
+    // этого же варианта ядер, а переставляет произвольные блоки
+    InPlaceApi api;
+    if (LoadInPlaceApi(loaded, api)) {
+        void* context = api.createContext(key.key);
+        size_t blockSize = api.bound(context, 1);
+        api.destroyContext(context);
+        size_t length = max<size_t>(1, (1 << 20) / blockSize) * blockSize;
+        record("decrypt:" + to_string(length), [&] {
+            WriteFile(in, MakeData(length, 12));
+            plugin.fileDecrypt(in, decrypted, key.key);
+            return ReadFile(decrypted);
+        });
+    }
+
+    string ascii, cyrillic;
+    for (int i = 0; i < 2000; ++i) {
+        ascii += "The quick brown fox jumps over the lazy dog. ";
+        cyrillic += "Съешь же ещё этих мягких французских булок. ";
+    }
+    record("text-ascii", [&] { return plugin.textEncrypt(ascii, key.key); });
+    record("text-utf8", [&] { return plugin.textEncrypt(cyrillic, key.key); });
+    record("text-utf8-decrypt", [&] { return plugin.textDecrypt(cyrillic, key.key); });
+    record("text-invalid", [&] { return plugin.textEncrypt(cyrillic + "\xd0\xbf\x80" + cyrillic, key.key); });
+    return digests;
+}
+
+// Свёртки этого же процесса, запущенного с CRYPTOGRAPHY_ISA=isa: вариант ядер выбирается
+// при загрузке библиотек, поэтому для каждого варианта нужен отдельный процесс
+vector<string> ChildDigests(const TestOptions& options, const char* isa) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        throw runtime_error("Не удалось создать канал");
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        throw runtime_error("Не удалось запустить процесс проверки");
+    }
+    if (child == 0) {
+        dup2(pipeFds[1], STDOUT_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        setenv(ISA_ENV, isa, 1);
+        execl("/proc/self/exe", "selftest", "--lib-dir", options.libDirectory.c_str(), "--dir", options.workDirectory.c_str(),
+              "--digests", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(pipeFds[1]);
+    string output;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(pipeFds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, static_cast<size_t>(got));
+    }
+    close(pipeFds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw runtime_error(string("Процесс проверки с ") + ISA_ENV + "=" + isa + " завершился с ошибкой");
+    }
+
+    vector<string> digests;
+    istringstream lines(output);
+    string line;
+    while (getline(lines, line)) {
+        digests.push_back(line);
+    }
+    return digests;
+}
+
+// Каждый вариант ядер ниже выбранного даёт те же байты, что и выбранный
+void TestIsaLevels(const TestOptions& options, const vector<string>& digests) {
+    IsaLevel current = GetIsaLevel();
+    for (int level = static_cast<int>(IsaLevel::SCALAR); level < static_cast<int>(current); ++level) {
+        const char* isa = IsaLevelName(static_cast<IsaLevel>(level));
+        try {
+            vector<string> other = ChildDigests(options, isa);
+            Check(other.size() == digests.size(), string(isa) + ": другое количество случаев");
+            for (size_t i = 0; i < min(other.size(), digests.size()); ++i) {
+                Check(other[i] == digests[i], string(isa) + " и " + IsaLevelName(current) + " расходятся: " + other[i] +
+                                                  " вместо " + digests[i]);
+            }
+            cout << "Ядра " << isa << " и " << IsaLevelName(current) << ": " << (other == digests ? "OK" : "ОШИБКИ") << endl;
+        } catch (const exception& e) {
+            Check(false, e.what());
+        }
+    }
+}
+
+const LoadedCipher* FindCipher(const CipherRegistry& registry, const char* name) {
+    for (const LoadedCipher& cipher : registry.Ciphers()) {
+        if (name == string(cipher.plugin->name)) {
+            return &cipher;
+        }
+    }
+    return nullptr;
+}
+
+void PrintUsage(ostream& out) {
+    out << "Использование: selftest [параметры]\n"
+        << "  --lib-dir КАТ     каталог библиотек шифров (по умолчанию " << DEFAULT_LIB_DIRECTORY << ")\n"
+        << "  --dir КАТ         каталог для временных файлов (по умолчанию /tmp)\n"
+        << "  --digests         только вывести свёртки результатов для сравнения вариантов ядер\n";
+}
+
+int main(int argc, char* argv[]) {
+    TestOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto value = [&]() -> string {
+                if (i + 1 >= argc) {
+                    throw invalid_argument("Не указано значение параметра " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--lib-dir") {
+                options.libDirectory = value();
+            } else if (arg == "--dir") {
+                options.workDirectory = value();
+            } else if (arg == "--digests") {
+                options.digests = true;
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(cout);
+                return 0;
+            } else {
+                throw invalid_argument("Неизвестный параметр: " + arg);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "ОШИБКА! " << e.what() << endl;
+        PrintUsage(cerr);
+        return 2;
+    }
+
+    CipherRegistry registry;
+    vector<string> errors;
+    registry.LoadDirectory(options.libDirectory, errors);
+    for (const string& error : errors) {
+        cerr << "Предупреждение: " << error << endl;
+    }
+
+    string dirTemplate = options.workDirectory + "/selftest-XXXXXX";
+    if (!mkdtemp(&dirTemplate[0])) {
+        cerr << "ОШИБКА! Не удалось создать временный каталог в " << options.workDirectory << endl;
+        return 1;
+    }
+    const string dir = dirTemplate;
+
+    vector<string> digests;
+    for (const TestKey& key : TEST_KEYS) {
+        if (const LoadedCipher* loaded = FindCipher(registry, key.cipher)) {
+            for (const string& digest : CipherDigests(*loaded, key, dir)) {
+                digests.push_back(digest);
+            }
+        }
+    }
+
+    // Процесс сравнения вариантов ядер только выводит свёртки
+    if (!options.digests) {
+        for (const TestKey& key : TEST_KEYS) {
+            const LoadedCipher* loaded = FindCipher(registry, key.cipher);
+            if (!loaded) {
+                Check(false, string("Библиотека шифра не найдена: ") + key.cipher);
+                continue;
+            }
+
+            int failuresBefore = failures;
+            const CipherPlugin& plugin = *loaded->plugin;
+            plugin.setChunkSize(TEST_CHUNK_SIZE);
+            TestRoundTrips(plugin, key, dir);
+            TestTrailingZeros(plugin, key, dir);
+            TestCorruptedHeaders(plugin, key, dir);
+            TestRanges(plugin, key, dir);
+            TestInPlace(*loaded, key, dir);
+            TestUtf8(plugin, key);
+            plugin.setChunkSize(4 << 20);
+            cout << key.cipher << " " << key.key << ": " << (failures == failuresBefore ? "OK" : "ОШИБКИ") << endl;
+        }
+    }
+
+    for (const char* name : {"plain", "encrypted", "corrupted", "decrypted"}) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+
+    if (options.digests) {
+        for (const string& digest : digests) {
+            cout << digest << "\n";
+        }
+        return 0;
+    }
+    TestIsaLevels(options, digests);
+
+    cout << "Проверок: " << checks << ", ошибок: " << failures << endl;
+    return failures == 0 ? 0 : 1;
+}
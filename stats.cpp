@@ -0,0 +1,177 @@
+#include "stats.h"
+#include "trace.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const size_t STAT_COUNT = static_cast<size_t>(Stat::COUNT);
+
+// Набор одного потока: пишет только владелец, поэтому хватает загрузки и записи
+// без атомарного сложения; атомарность нужна для чтения из GetCipherStats
+struct ThreadCounters {
+    atomic<uint64_t> values[STAT_COUNT] = {};
+};
+
+// Наборы живых потоков и сумма завершившихся. Не удаляется: потоки могут завершаться
+// и после разрушения статических объектов библиотеки
+struct StatsRegistry {
+    mutex lock;
+    vector<ThreadCounters*> live;
+    uint64_t retired[STAT_COUNT] = {};
+};
+
+static StatsRegistry& Registry() {
+    static StatsRegistry* registry = new StatsRegistry;
+    return *registry;
+}
+
+// Регистрирует набор потока при первом учёте и переносит его в сумму при завершении потока
+struct ThreadSlot {
+    ThreadCounters counters;
+
+    ThreadSlot() {
+        StatsRegistry& registry = Registry();
+        lock_guard<mutex> guard(registry.lock);
+        registry.live.push_back(&counters);
+    }
+    ~ThreadSlot() {
+        StatsRegistry& registry = Registry();
+        lock_guard<mutex> guard(registry.lock);
+        for (size_t i = 0; i < STAT_COUNT; ++i) {
+            registry.retired[i] += counters.values[i].load(memory_order_relaxed);
+        }
+        registry.live.erase(find(registry.live.begin(), registry.live.end(), &counters));
+    }
+};
+
+static ThreadCounters& LocalCounters() {
+    thread_local ThreadSlot slot;
+    return slot.counters;
+}
+
+static atomic<bool> enabled(false);
+
+void SetStatsEnabled(bool value) {
+    enabled.store(value, memory_order_relaxed);
+}
+
+bool StatsEnabled() {
+    return enabled.load(memory_order_relaxed);
+}
+
+void CountStat(Stat stat, uint64_t value) {
+    if (!enabled.load(memory_order_relaxed)) {
+        return;
+    }
+    atomic<uint64_t>& counter = LocalCounters().values[static_cast<size_t>(stat)];
+    counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+CipherStats GetCipherStats() {
+    uint64_t sum[STAT_COUNT];
+    {
+        StatsRegistry& registry = Registry();
+        lock_guard<mutex> guard(registry.lock);
+        copy(registry.retired, registry.retired + STAT_COUNT, sum);
+        for (ThreadCounters* counters : registry.live) {
+            for (size_t i = 0; i < STAT_COUNT; ++i) {
+                sum[i] += counters->values[i].load(memory_order_relaxed);
+            }
+        }
+    }
+
+    auto get = [&](Stat stat) {
+        return sum[static_cast<size_t>(stat)];
+    };
+    CipherStats stats;
+    stats.calls = get(Stat::CALLS);
+    stats.bytesIn = get(Stat::BYTES_IN);
+    stats.bytesOut = get(Stat::BYTES_OUT);
+    stats.blocks = get(Stat::BLOCKS);
+    stats.paddingAdded = get(Stat::PADDING_ADDED);
+    stats.paddingStripped = get(Stat::PADDING_STRIPPED);
+    stats.allocations = get(Stat::ALLOCATIONS);
+    stats.allocatedBytes = get(Stat::ALLOCATED_BYTES);
+    stats.keySetupNs = get(Stat::KEY_SETUP_NS);
+    stats.readNs = get(Stat::READ_NS);
+    stats.transformNs = get(Stat::TRANSFORM_NS);
+    stats.writeNs = get(Stat::WRITE_NS);
+    stats.waitNs = get(Stat::WAIT_NS);
+    return stats;
+}
+
+void ResetCipherStats() {
+    StatsRegistry& registry = Registry();
+    lock_guard<mutex> guard(registry.lock);
+    fill(registry.retired, registry.retired + STAT_COUNT, 0);
+    for (ThreadCounters* counters : registry.live) {
+        for (size_t i = 0; i < STAT_COUNT; ++i) {
+            counters->values[i].store(0, memory_order_relaxed);
+        }
+    }
+}
+
+// Включает сбор по STATS_ENV при загрузке и дописывает счётчики в файл при выгрузке
+class StatsDump {
+public:
+    StatsDump() {
+        const char* value = getenv(STATS_ENV);
+        if (!value || !*value) {
+            return;
+        }
+        SetStatsEnabled(true);
+        if (strcmp(value, "1") != 0) {
+            path = value;
+        }
+    }
+    ~StatsDump() {
+        if (!path.empty()) {
+            Write();
+        }
+    }
+
+private:
+    void Write() {
+        CipherStats s = GetCipherStats();
+        // Библиотеки, загруженные, но не использованные процессом, не засоряют файл
+        if (s.calls == 0) {
+            return;
+        }
+        char line[1024];
+        int length = snprintf(line, sizeof(line),
+            "{\"library\": \"%s\", \"pid\": %d, \"calls\": %llu, \"bytes_in\": %llu, \"bytes_out\": %llu, "
+            "\"blocks\": %llu, \"padding_added\": %llu, \"padding_stripped\": %llu, \"allocations\": %llu, "
+            "\"allocated_bytes\": %llu, \"key_setup_ns\": %llu, \"read_ns\": %llu, \"transform_ns\": %llu, "
+            "\"write_ns\": %llu, \"wait_ns\": %llu}\n",
+            ModuleName().c_str(), static_cast<int>(getpid()),
+            static_cast<unsigned long long>(s.calls), static_cast<unsigned long long>(s.bytesIn),
+            static_cast<unsigned long long>(s.bytesOut), static_cast<unsigned long long>(s.blocks),
+            static_cast<unsigned long long>(s.paddingAdded), static_cast<unsigned long long>(s.paddingStripped),
+            static_cast<unsigned long long>(s.allocations), static_cast<unsigned long long>(s.allocatedBytes),
+            static_cast<unsigned long long>(s.keySetupNs), static_cast<unsigned long long>(s.readNs),
+            static_cast<unsigned long long>(s.transformNs), static_cast<unsigned long long>(s.writeNs),
+            static_cast<unsigned long long>(s.waitNs));
+        // Одна запись с O_APPEND: строки нескольких библиотек и процессов не перемешиваются
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+        if (fd < 0) {
+            return;
+        }
+        if (write(fd, line, static_cast<size_t>(min<int>(length, sizeof(line) - 1))) < 0) {
+            // Выгрузка библиотеки не должна завершаться ошибкой из-за статистики
+        }
+        close(fd);
+    }
+
+    string path;
+};
+
+static StatsDump statsDump;
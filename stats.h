@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include "plugin.h"
+#include "trace.h"
+
+// Счётчики горячего пути библиотеки. Каждый поток пишет в собственный набор без блокировок,
+// GetCipherStats складывает наборы всех потоков. Пока сбор выключен, точка учёта сводится
+// к проверке флага
+enum class Stat {
+    CALLS,
+    BYTES_IN,
+    BYTES_OUT,
+    BLOCKS,
+    PADDING_ADDED,
+    PADDING_STRIPPED,
+    ALLOCATIONS,
+    ALLOCATED_BYTES,
+    KEY_SETUP_NS,
+    READ_NS,
+    TRANSFORM_NS,
+    WRITE_NS,
+    WAIT_NS,
+    COUNT
+};
+
+// Сбор включается при загрузке библиотеки, если переменная задана. Значение, отличное от "1", -
+// путь файла, в который при выгрузке библиотеки дописывается строка JSON со счётчиками
+const char* const STATS_ENV = "CRYPTOGRAPHY_STATS";
+
+void SetStatsEnabled(bool enabled);
+bool StatsEnabled();
+
+void CountStat(Stat stat, uint64_t value = 1);
+
+// Выделение буфера данных или результата
+inline void CountAllocation(size_t bytes) {
+    CountStat(Stat::ALLOCATIONS);
+    CountStat(Stat::ALLOCATED_BYTES, bytes);
+}
+
+// Сумма по всем потокам, включая завершившиеся
+CipherStats GetCipherStats();
+
+// Обнуление счётчиков; учёт, идущий в других потоках в этот момент, может частично сохраниться
+void ResetCipherStats();
+
+// Имя фазы для трассировки по счётчику времени
+constexpr const char* StatPhaseName(Stat stat) {
+    switch (stat) {
+        case Stat::KEY_SETUP_NS:
+            return "key_setup";
+        case Stat::READ_NS:
+            return "read";
+        case Stat::TRANSFORM_NS:
+            return "transform";
+        case Stat::WRITE_NS:
+            return "write";
+        case Stat::WAIT_NS:
+            return "wait";
+        default:
+            return "other";
+    }
+}
+
+// Время от создания до уничтожения в наносекундах добавляется к счётчику stat;
+// тот же отрезок отмечается как фаза трассировки
+class StatTimer {
+public:
+    explicit StatTimer(Stat stat, uint64_t bytes = 0) : stat(stat), span(StatPhaseName(stat), bytes), running(StatsEnabled()) {
+        if (running) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~StatTimer() {
+        if (running) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            CountStat(stat, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+    StatTimer(const StatTimer&) = delete;
+    StatTimer& operator=(const StatTimer&) = delete;
+
+    void SetBytes(uint64_t bytes) { span.SetBytes(bytes); }
+
+private:
+    Stat stat;
+    TraceSpan span;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+
+// Общий объём таблиц, которые кэш держит без внешних ссылок
+const size_t TABLE_CACHE_LIMIT = 256 << 20;
+
+// Таблицы размеров, которые строятся во время выполнения: у большого квадрата они занимают
+// десятки мегабайт, а короткий текст шифруется квадратом по своей длине, так что размеров
+// может быть много. Недавно использованные таблицы остаются, пока их общий объём
+// (Tables::TableBytes()) не больше TABLE_CACHE_LIMIT; вытесненные живут, пока на них есть ссылки.
+// Ключ - размер квадрата или, у каскада, строка шагов
+template <typename Tables, typename Key = int>
+class TableCache {
+public:
+    // build() вызывается под блокировкой: один ключ не строится дважды одновременно
+    template <typename Build>
+    std::shared_ptr<const Tables> Get(const Key& key, Build build) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->key == key) {
+                entries.splice(entries.begin(), entries, it);
+                return it->tables;
+            }
+        }
+
+        std::shared_ptr<const Tables> tables = build();
+        size_t bytes = tables->TableBytes();
+        entries.push_front({key, bytes, tables});
+        total += bytes;
+        while (total > TABLE_CACHE_LIMIT && entries.size() > 1) {
+            total -= entries.back().bytes;
+            entries.pop_back();
+        }
+        return tables;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        size_t bytes;
+        std::shared_ptr<const Tables> tables;
+    };
+
+    std::mutex lock;
+    std::list<Entry> entries;
+    size_t total = 0;
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include "utf8.h"
+#include "stats.h"
+
+// Размер результата поблочной перестановки текста: все символы плюс пробелы,
+// дополняющие последний блок. starts - индекс символов из IndexCodePoints
+inline size_t GatheredTextSize(const std::vector<uint32_t>& starts, size_t blockSize) {
+    size_t count = starts.size() - 1;
+    size_t blocks = (count + blockSize - 1) / blockSize;
+    return starts.back() + (blocks * blockSize - count);
+}
+
+// Перестановка символов по таблице выборки прямо в out: символ k блока берётся из позиции
+// gather[k] того же блока, недостающие символы последнего блока заменяются пробелами.
+// В out должно быть GatheredTextSize байт; возвращает количество записанных байт
+template <typename Index>
+size_t GatherTextInto(const char* text, const std::vector<uint32_t>& starts, const std::vector<Index>& gather, char* out) {
+    size_t count = starts.size() - 1;
+    size_t blockSize = gather.size();
+    char* position = out;
+
+    for (size_t block = 0; block < count; block += blockSize) {
+        for (size_t k = 0; k < blockSize; ++k) {
+            size_t index = block + gather[k];
+            if (index < count) {
+                size_t charLength = starts[index + 1] - starts[index];
+                memcpy(position, text + starts[index], charLength);
+                position += charLength;
+            } else {
+                *position++ = ' ';
+            }
+        }
+    }
+
+    return static_cast<size_t>(position - out);
+}
+
+// Длина текста без пробелов в конце
+inline size_t TrimmedLength(const char* text, size_t length) {
+    while (length > 0 && text[length - 1] == ' ') {
+        --length;
+    }
+    return length;
+}
+
+// Байтовая перестановка целых блоков по таблице выборки
+template <typename Index>
+void GatherBytes(const char* src, char* dst, size_t length, const std::vector<Index>& gather) {
+    size_t blockSize = gather.size();
+    for (size_t block = 0; block + blockSize <= length; block += blockSize) {
+        for (size_t k = 0; k < blockSize; ++k) {
+            dst[block + k] = src[block + gather[k]];
+        }
+    }
+}
+
+// Для ASCII символ - это байт, и перестановка текста совпадает с байтовой, только последний
+// блок дополняется пробелами. transform(src, dst, length) переставляет целые блоки;
+// в out должно быть место для длины, округлённой вверх до блока. Возвращает записанную длину
+template <typename Transform>
+size_t TransformAsciiInto(const char* text, size_t length, size_t blockSize, char* out, Transform transform) {
+    size_t fullLength = length - length % blockSize;
+    transform(text, out, fullLength);
+    if (fullLength == length) {
+        return length;
+    }
+
+    std::string lastBlock(blockSize, ' ');
+    memcpy(&lastBlock[0], text + fullLength, length - fullLength);
+    transform(lastBlock.data(), out + fullLength, blockSize);
+    return fullLength + blockSize;
+}
+
+// Учёт перестановки одного текста: written байт переставлено, в результате length байт
+inline void CountText(size_t inLength, size_t written, size_t length, bool trimSpaces) {
+    CountStat(Stat::BYTES_IN, inLength);
+    CountStat(Stat::BYTES_OUT, length);
+    CountStat(trimSpaces ? Stat::PADDING_STRIPPED : Stat::PADDING_ADDED, trimSpaces ? written - length : written - inLength);
+}
+
+template <typename Transform>
+std::string TransformAsciiText(const std::string& text, size_t blockSize, bool trimSpaces, Transform transform) {
+    std::string result((text.size() + blockSize - 1) / blockSize * blockSize, ' ');
+    CountAllocation(result.size());
+    size_t written = TransformAsciiInto(text.data(), text.size(), blockSize, &result[0], transform);
+    result.resize(trimSpaces ? TrimmedLength(result.data(), written) : written);
+    CountText(text.size(), written, result.size(), trimSpaces);
+    return result;
+}
+
+// Перестановка одного текста: индекс символов и результат точного размера - единственные выделения памяти
+template <typename Index>
+std::string GatherText(const std::string& text, const std::vector<Index>& gather, bool trimSpaces) {
+    StatTimer timer(Stat::TRANSFORM_NS, text.size());
+    std::vector<uint32_t> starts;
+    IndexCodePoints(text.data(), text.size(), starts);
+    CountAllocation(starts.capacity() * sizeof(uint32_t));
+
+    std::string result(GatheredTextSize(starts, gather.size()), ' ');
+    CountAllocation(result.size());
+    size_t written = GatherTextInto(text.data(), starts, gather, &result[0]);
+    result.resize(trimSpaces ? TrimmedLength(result.data(), written) : written);
+    CountStat(Stat::BLOCKS, (starts.size() - 1 + gather.size() - 1) / gather.size());
+    CountText(text.size(), written, result.size(), trimSpaces);
+    return result;
+}
+
+// Пакетная перестановка count сообщений в один буфер: результат сообщения i занимает
+// out[offsets[i], offsets[i + 1]), в offsets count + 1 элементов. tableFor(length)
+// возвращает таблицу выборки для сообщения такой длины. ASCII-сообщения переставляются побайтно;
+// индекс символов остальных переиспользуется, так что память выделяется только при его росте
+template <typename TableFor>
+size_t GatherTextBatch(const char* const* inputs, const size_t* lengths, size_t count,
+                       char* out, size_t capacity, size_t* offsets, bool trimSpaces, TableFor tableFor) {
+    StatTimer timer(Stat::TRANSFORM_NS);
+    std::vector<uint32_t> starts;
+    size_t position = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = position;
+        if (lengths[i] == 0) {
+            continue;
+        }
+
+        const auto& gather = tableFor(lengths[i]);
+        size_t blockSize = gather.size();
+        size_t written;
+        size_t characters = lengths[i];
+        if (IsAscii(inputs[i], lengths[i])) {
+            if (capacity - position < (lengths[i] + blockSize - 1) / blockSize * blockSize) {
+                throw std::length_error("Недостаточный размер выходного буфера");
+            }
+            written = TransformAsciiInto(inputs[i], lengths[i], blockSize, out + position, [&](const char* src, char* dst, size_t length) {
+                GatherBytes(src, dst, length, gather);
+            });
+        } else {
+            size_t reserved = starts.capacity();
+            IndexCodePoints(inputs[i], lengths[i], starts);
+            if (starts.capacity() != reserved) {
+                CountAllocation(starts.capacity() * sizeof(uint32_t));
+            }
+            if (capacity - position < GatheredTextSize(starts, blockSize)) {
+                throw std::length_error("Недостаточный размер выходного буфера");
+            }
+            written = GatherTextInto(inputs[i], starts, gather, out + position);
+            characters = starts.size() - 1;
+        }
+        size_t length = trimSpaces ? TrimmedLength(out + position, written) : written;
+        CountStat(Stat::BLOCKS, (characters + blockSize - 1) / blockSize);
+        CountText(lengths[i], written, length, trimSpaces);
+        position += length;
+    }
+
+    offsets[count] = position;
+    return position;
+}
+
+// Размер буфера, достаточный для пакетной обработки сообщений с блоком не больше blockSize
+inline size_t GatherTextBatchBound(const size_t* lengths, size_t count, size_t blockSize) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += lengths[i] + (lengths[i] == 0 ? 0 : blockSize - 1);
+    }
+    return total;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+// Трассировка фаз обработки. Каждая фаза отмечается статическими точками USDT
+// cryptography:phase_start и cryptography:phase_done (аргументы: имя фазы и размер
+// в байтах), которые подключаются perf и bpftrace без пересборки; пока к ним никто
+// не подключён, точка - одна инструкция nop. Если задана переменная CRYPTOGRAPHY_TRACE,
+// фазы дополнительно записываются в указанный файл в формате Chrome trace event
+// (chrome://tracing, Perfetto); программа и библиотеки дописывают в один файл
+const char* const TRACE_ENV = "CRYPTOGRAPHY_TRACE";
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CRYPTOGRAPHY_PROBE2(name, arg1, arg2) STAP_PROBE2(cryptography, name, arg1, arg2)
+#endif
+#endif
+
+#if !defined(CRYPTOGRAPHY_PROBE2) && defined(__x86_64__)
+// Та же заметка .note.stapsdt, что создаёт sys/sdt.h, для сборки без systemtap-sdt-dev
+#define CRYPTOGRAPHY_PROBE2(name, arg1, arg2)                                        \
+    __asm__ __volatile__("990: nop\n"                                                \
+                         ".pushsection .note.stapsdt,\"?\",\"note\"\n"               \
+                         ".balign 4\n"                                               \
+                         ".4byte 992f-991f, 994f-993f, 3\n"                          \
+                         "991: .asciz \"stapsdt\"\n"                                 \
+                         "992: .balign 4\n"                                          \
+                         "993: .8byte 990b\n"                                        \
+                         ".8byte _.stapsdt.base\n"                                   \
+                         ".8byte 0\n"                                                \
+                         ".asciz \"cryptography\"\n"                                 \
+                         ".asciz \"" #name "\"\n"                                    \
+                         ".asciz \"8@%0 8@%1\"\n"                                    \
+                         "994: .balign 4\n"                                          \
+                         ".popsection\n"                                             \
+                         ".ifndef _.stapsdt.base\n"                                  \
+                         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+                         ".weak _.stapsdt.base\n"                                    \
+                         ".hidden _.stapsdt.base\n"                                  \
+                         "_.stapsdt.base: .space 1\n"                                \
+                         ".size _.stapsdt.base, 1\n"                                 \
+                         ".popsection\n"                                             \
+                         ".endif\n"                                                  \
+                         :                                                           \
+                         : "nor"(reinterpret_cast<uint64_t>(arg1)), "nor"(static_cast<uint64_t>(arg2)))
+#endif
+
+#ifndef CRYPTOGRAPHY_PROBE2
+#define CRYPTOGRAPHY_PROBE2(name, arg1, arg2) ((void)(arg1), (void)(arg2))
+#endif
+
+bool TracingEnabled();
+
+// Завершённая фаза для файла трассировки; буферизуется в потоке и записывается порциями
+void TraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint64_t bytes);
+
+// Имя файла программы или библиотеки, в которую собран этот код
+std::string ModuleName();
+
+// Фаза от создания до уничтожения; name должна быть строковой константой
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, uint64_t bytes = 0) : name(name), bytes(bytes), tracing(TracingEnabled()) {
+        CRYPTOGRAPHY_PROBE2(phase_start, name, bytes);
+        if (tracing) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~TraceSpan() {
+        CRYPTOGRAPHY_PROBE2(phase_done, name, bytes);
+        if (tracing) {
+            TraceEvent(name, start, std::chrono::steady_clock::now(), bytes);
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    // Размер, ставший известным только к концу фазы
+    void SetBytes(uint64_t value) { bytes = value; }
+
+private:
+    const char* name;
+    uint64_t bytes;
+    bool tracing;
+    std::chrono::steady_clock::time_point start;
+};
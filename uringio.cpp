@@ -0,0 +1,547 @@
+#include "uringio.h"
+#include "fdstream.h"
+#include "parallel.h"
+#include "stats.h"
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+static thread_local AsyncIoStats lastStats = {};
+
+AsyncIoStats GetAsyncIoStats() {
+    return lastStats;
+}
+
+// Порции одной операции: результат [0, outLength) делится на порции по chunk байт,
+// порция читается из входа по смещению inStart + offset; за концом данных inSize - нули
+struct Transfer {
+    int inFd;
+    int outFd;
+    uint64_t inStart;
+    uint64_t inSize;
+    uint64_t outLength;
+    size_t chunk;
+    size_t blockSize;
+    const BlockTransform* transform;
+    string inPath;
+    string outPath;
+
+    uint64_t ChunkCount() const {
+        return (outLength + chunk - 1) / chunk;
+    }
+    size_t OutLength(uint64_t index) const {
+        return static_cast<size_t>(min<uint64_t>(chunk, outLength - index * chunk));
+    }
+    size_t PaddedLength(uint64_t index) const {
+        size_t length = OutLength(index);
+        return (length + blockSize - 1) / blockSize * blockSize;
+    }
+    size_t ReadLength(uint64_t index) const {
+        uint64_t offset = index * chunk;
+        return offset < inSize ? static_cast<size_t>(min<uint64_t>(PaddedLength(index), inSize - offset)) : 0;
+    }
+};
+
+// Дополнение прочитанной порции нулями до блока и преобразование
+static void TransformChunk(const Transfer& transfer, uint64_t index, uint8_t* in, uint8_t* out) {
+    size_t read = transfer.ReadLength(index);
+    size_t padded = transfer.PaddedLength(index);
+    fill(in + read, in + padded, 0);
+    ParallelTransform(in, out, padded, transfer.blockSize, *transfer.transform);
+}
+
+static void ThrowChangedInput(const Transfer& transfer) {
+    throw runtime_error("Входной файл изменился во время обработки: " + transfer.inPath);
+}
+
+// Кольца io_uring через системные вызовы, без liburing
+class Uring {
+public:
+    explicit Uring(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int result = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (result < 0) {
+            return;
+        }
+        fd = result;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = Map(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = singleMap ? sqRing : Map(cqRingSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(Map(sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes) {
+            return;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        sqeTail = *sqTail;
+
+        uint8_t* cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        ready = true;
+    }
+
+    ~Uring() {
+        if (sqes) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool Ready() const { return ready; }
+
+    // Регистрация буферов для операций READ_FIXED/WRITE_FIXED; при отказе (например,
+    // из-за ограничения на закреплённую память) используются обычные READ/WRITE
+    bool RegisterBuffers(const vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+    }
+
+    // Свободный элемент очереди отправки; очередь рассчитана так, что он есть всегда
+    io_uring_sqe* NextSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqeTail - head >= sqEntries) {
+            throw runtime_error("Переполнение очереди io_uring");
+        }
+        unsigned index = sqeTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        ++sqeTail;
+        ++pending;
+        return sqe;
+    }
+
+    // Отправляет подготовленные запросы и ждёт хотя бы waitCount завершений
+    void Submit(unsigned waitCount) {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        while (true) {
+            long result = syscall(__NR_io_uring_enter, fd, pending, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (result >= 0) {
+                pending -= static_cast<unsigned>(result);
+                return;
+            }
+            if (errno != EINTR) {
+                throw runtime_error(string("Ошибка io_uring: ") + strerror(errno));
+            }
+        }
+    }
+
+    bool PopCompletion(io_uring_cqe& cqe) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        cqe = cqes[head & cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void* Map(size_t size, off_t offset) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    int fd = -1;
+    bool ready = false;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqeTail = 0;
+    unsigned pending = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+// Конвейер на io_uring: у каждого слота свои буферы чтения и записи и не больше
+// одного запроса в обработке; слот проходит чтение, преобразование и запись порции
+static void RunUring(Uring& ring, const Transfer& transfer, unsigned depth, AsyncIoStats& stats) {
+    enum class State { FREE, READING, WRITING };
+    struct Slot {
+        State state = State::FREE;
+        uint64_t index = 0;
+        size_t done = 0;
+        vector<uint8_t> in;
+        vector<uint8_t> out;
+    };
+
+    uint64_t chunkCount = transfer.ChunkCount();
+    depth = static_cast<unsigned>(max<uint64_t>(1, min<uint64_t>(depth, chunkCount)));
+    vector<Slot> slots(depth);
+    vector<iovec> buffers;
+    for (auto& slot : slots) {
+        slot.in.resize(transfer.chunk);
+        slot.out.resize(transfer.chunk);
+        CountAllocation(transfer.chunk);
+        CountAllocation(transfer.chunk);
+        buffers.push_back({slot.in.data(), slot.in.size()});
+    }
+    for (auto& slot : slots) {
+        buffers.push_back({slot.out.data(), slot.out.size()});
+    }
+    bool fixed = ring.RegisterBuffers(buffers);
+
+    unsigned inFlight = 0;
+    double inFlightSum = 0;
+    uint64_t samples = 0;
+
+    auto queue = [&](size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        bool reading = slot.state == State::READING;
+        uint64_t offset = slot.index * transfer.chunk + slot.done;
+        size_t total = reading ? transfer.ReadLength(slot.index) : transfer.OutLength(slot.index);
+        uint8_t* buffer = (reading ? slot.in.data() : slot.out.data()) + slot.done;
+
+        io_uring_sqe* sqe = ring.NextSqe();
+        if (fixed) {
+            sqe->opcode = reading ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            sqe->buf_index = static_cast<uint16_t>(reading ? slotIndex : depth + slotIndex);
+        } else {
+            sqe->opcode = reading ? IORING_OP_READ : IORING_OP_WRITE;
+        }
+        sqe->fd = reading ? transfer.inFd : transfer.outFd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        // Длина запроса 32-битная: порция больше 1 ГБ передаётся несколькими запросами,
+        // как и при неполном завершении
+        sqe->len = static_cast<uint32_t>(min<size_t>(total - slot.done, 1u << 30));
+        sqe->off = reading ? transfer.inStart + offset : offset;
+        sqe->user_data = slotIndex;
+        ++inFlight;
+        ++stats.requests;
+        stats.maxInFlight = max(stats.maxInFlight, inFlight);
+    };
+
+    auto startWrite = [&](size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        TransformChunk(transfer, slot.index, slot.in.data(), slot.out.data());
+        slot.state = State::WRITING;
+        slot.done = 0;
+        queue(slotIndex);
+    };
+
+    uint64_t nextChunk = 0;
+    uint64_t finished = 0;
+    try {
+        while (finished < chunkCount) {
+            for (size_t i = 0; i < slots.size() && nextChunk < chunkCount; ++i) {
+                if (slots[i].state != State::FREE) {
+                    continue;
+                }
+                slots[i].index = nextChunk++;
+                slots[i].done = 0;
+                slots[i].state = State::READING;
+                if (transfer.ReadLength(slots[i].index) == 0) {
+                    startWrite(i);
+                } else {
+                    queue(i);
+                }
+            }
+
+            {
+                // Все слоты ждут ядра: обработка быстрее ввода-вывода
+                StatTimer timer(Stat::WAIT_NS);
+                ring.Submit(1);
+            }
+            inFlightSum += inFlight;
+            ++samples;
+
+            io_uring_cqe cqe;
+            while (ring.PopCompletion(cqe)) {
+                --inFlight;
+                size_t slotIndex = static_cast<size_t>(cqe.user_data);
+                Slot& slot = slots[slotIndex];
+                bool reading = slot.state == State::READING;
+                if (cqe.res < 0) {
+                    const string& path = reading ? transfer.inPath : transfer.outPath;
+                    throw runtime_error((reading ? "Ошибка чтения входного файла: " : "Ошибка записи в выходной файл: ") +
+                                        path + ": " + strerror(-cqe.res));
+                }
+                if (cqe.res == 0 && reading) {
+                    ThrowChangedInput(transfer);
+                }
+
+                slot.done += static_cast<size_t>(cqe.res);
+                CountStat(reading ? Stat::BYTES_IN : Stat::BYTES_OUT, static_cast<uint64_t>(cqe.res));
+                size_t total = reading ? transfer.ReadLength(slot.index) : transfer.OutLength(slot.index);
+                if (slot.done < total) {
+                    queue(slotIndex);
+                } else if (reading) {
+                    startWrite(slotIndex);
+                } else {
+                    slot.state = State::FREE;
+                    ++finished;
+                }
+            }
+        }
+    } catch (...) {
+        // Буферы нельзя освобождать, пока ядро ещё работает с ними
+        try {
+            while (inFlight > 0) {
+                ring.Submit(1);
+                io_uring_cqe cqe;
+                while (ring.PopCompletion(cqe)) {
+                    --inFlight;
+                }
+            }
+        } catch (...) {
+        }
+        throw;
+    }
+
+    stats.averageInFlight = samples ? inFlightSum / samples : 0;
+}
+
+// Резервный путь: потоки по числу слотов обрабатывают порции через pread/pwrite
+static void RunThreads(const Transfer& transfer, unsigned depth, AsyncIoStats& stats) {
+    uint64_t chunkCount = transfer.ChunkCount();
+    depth = static_cast<unsigned>(max<uint64_t>(1, min<uint64_t>(depth, chunkCount)));
+
+    atomic<uint64_t> nextChunk(0);
+    atomic<unsigned> inFlight(0);
+    atomic<unsigned> maxInFlight(0);
+    atomic<uint64_t> inFlightSum(0);
+    atomic<uint64_t> requests(0);
+    atomic<bool> failed(false);
+    exception_ptr error;
+    mutex errorMutex;
+
+    auto beginRequest = [&]() {
+        unsigned current = ++inFlight;
+        unsigned seen = maxInFlight;
+        while (current > seen && !maxInFlight.compare_exchange_weak(seen, current)) {
+        }
+        inFlightSum += current;
+        ++requests;
+    };
+
+    auto worker = [&]() {
+        vector<uint8_t> in(transfer.chunk), out(transfer.chunk);
+        CountAllocation(transfer.chunk);
+        CountAllocation(transfer.chunk);
+        try {
+            for (uint64_t index = nextChunk++; index < chunkCount && !failed; index = nextChunk++) {
+                uint64_t offset = index * transfer.chunk;
+                size_t readLength = transfer.ReadLength(index);
+                size_t done = 0;
+                while (done < readLength) {
+                    beginRequest();
+                    StatTimer timer(Stat::READ_NS, readLength - done);
+                    ssize_t got = pread(transfer.inFd, in.data() + done, readLength - done,
+                                        static_cast<off_t>(transfer.inStart + offset + done));
+                    --inFlight;
+                    if (got < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (got < 0) {
+                        throw runtime_error("Ошибка чтения входного файла: " + transfer.inPath + ": " + strerror(errno));
+                    }
+                    if (got == 0) {
+                        ThrowChangedInput(transfer);
+                    }
+                    done += static_cast<size_t>(got);
+                }
+                CountStat(Stat::BYTES_IN, readLength);
+
+                TransformChunk(transfer, index, in.data(), out.data());
+
+                size_t outLength = transfer.OutLength(index);
+                done = 0;
+                while (done < outLength) {
+                    beginRequest();
+                    StatTimer timer(Stat::WRITE_NS, outLength - done);
+                    ssize_t put = pwrite(transfer.outFd, out.data() + done, outLength - done, static_cast<off_t>(offset + done));
+                    --inFlight;
+                    if (put < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (put < 0) {
+                        throw runtime_error("Ошибка записи в выходной файл: " + transfer.outPath + ": " + strerror(errno));
+                    }
+                    done += static_cast<size_t>(put);
+                }
+                CountStat(Stat::BYTES_OUT, outLength);
+            }
+        } catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error) {
+                error = current_exception();
+            }
+            failed = true;
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned i = 1; i < depth; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    stats.maxInFlight = maxInFlight;
+    stats.requests = requests;
+    stats.averageInFlight = requests ? static_cast<double>(inFlightSum) / requests : 0;
+}
+
+static void RunTransfer(const Transfer& transfer, unsigned queueDepth) {
+    AsyncIoStats stats = {};
+    stats.queueDepth = queueDepth;
+    if (transfer.outLength > 0) {
+        Uring ring(queueDepth);
+        if (ring.Ready()) {
+            RunUring(ring, transfer, queueDepth, stats);
+        } else {
+            stats.fallback = true;
+            RunThreads(transfer, queueDepth, stats);
+        }
+    }
+    lastStats = stats;
+}
+
+static int OpenInputFile(const string& inPath, uint64_t& size, bool& regular) {
+    int fd = open(inPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Не удалось открыть входной файл: " + inPath);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw runtime_error("Не удалось получить размер файла: " + inPath);
+    }
+    size = static_cast<uint64_t>(info.st_size);
+    regular = S_ISREG(info.st_mode);
+    return fd;
+}
+
+static int OpenOutputFile(const string& outPath) {
+    int fd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        throw runtime_error("Не удалось создать выходной файл: " + outPath);
+    }
+    return fd;
+}
+
+// Порция не больше результата: буферы слотов выделяются заранее
+static size_t ChunkFor(const BlockCipher& cipher, uint64_t outLength) {
+    size_t size = GetStreamChunkSize() != 0 ? GetStreamChunkSize() : DEFAULT_STREAM_CHUNK_SIZE;
+    size_t chunk = max(size - size % cipher.blockSize, cipher.blockSize);
+    uint64_t padded = (outLength + cipher.blockSize - 1) / cipher.blockSize * cipher.blockSize;
+    return static_cast<size_t>(max<uint64_t>(min<uint64_t>(chunk, padded), cipher.blockSize));
+}
+
+void UringEncryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher, unsigned queueDepth) {
+    uint64_t size = 0;
+    bool regular = false;
+    FileDescriptor input(OpenInputFile(inPath, size, regular));
+    if (!regular) {
+        // Для каналов и устройств чтение по смещениям невозможно
+        StreamEncryptFile(inPath, outPath, cipher);
+        return;
+    }
+    FileDescriptor output(OpenOutputFile(outPath));
+
+    uint64_t padded = (size + cipher.blockSize - 1) / cipher.blockSize * cipher.blockSize;
+    if (size == 0 && cipher.padEmpty) {
+        padded = cipher.blockSize;
+    }
+    Transfer transfer = {input.Get(), output.Get(), 0, size, padded, ChunkFor(cipher, padded), cipher.blockSize, &cipher.encrypt, inPath, outPath};
+    RunTransfer(transfer, queueDepth);
+    CountStat(Stat::PADDING_ADDED, padded - size);
+}
+
+void UringDecryptFile(const string& inPath, const string& outPath, const BlockCipher& cipher, unsigned queueDepth) {
+    uint64_t size = 0;
+    bool regular = false;
+    FileDescriptor input(OpenInputFile(inPath, size, regular));
+    if (!regular) {
+        StreamDecryptFile(inPath, outPath, cipher);
+        return;
+    }
+
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    size_t headerRead = ReadFull(input.Get(), buffer, FRAME_HEADER_SIZE, inPath);
+    FrameHeader header;
+    uint64_t dataStart = 0;
+    uint64_t plainLength = 0;
+    if (DecodeFrameHeader(buffer, headerRead, header)) {
+        if (!FrameMatchesCipher(header, cipher)) {
+            throw runtime_error("Файл зашифрован другим шифром или с другим ключом");
+        }
+        dataStart = FRAME_HEADER_SIZE;
+        plainLength = header.originalLength;
+        uint64_t dataSize = size - dataStart;
+        // Длина из заголовка сравнивается до округления: у повреждённого заголовка она может
+        // быть близка к 2^64, и округление вверх до блока переполнилось бы
+        if (plainLength > dataSize) {
+            throw runtime_error("Зашифрованный файл повреждён: данные короче длины из заголовка");
+        }
+        uint64_t needed = (plainLength + cipher.blockSize - 1) / cipher.blockSize * cipher.blockSize;
+        if (dataSize < needed) {
+            throw runtime_error(dataSize % cipher.blockSize != 0 ? "Зашифрованный файл повреждён: неполный последний блок"
+                                                                 : "Зашифрованный файл повреждён: данные короче длины из заголовка");
+        }
+    } else {
+        // Длина без нулевого дополнения известна заранее, поэтому порции пишутся сразу на место
+        plainLength = UnframedPlainLength(input.Get(), size, cipher);
+    }
+
+    FileDescriptor output(OpenOutputFile(outPath));
+    Transfer transfer = {input.Get(), output.Get(), dataStart, size - dataStart, plainLength, ChunkFor(cipher, plainLength), cipher.blockSize, &cipher.decrypt, inPath, outPath};
+    RunTransfer(transfer, queueDepth);
+    CountStat(Stat::PADDING_STRIPPED, size - dataStart - plainLength);
+}
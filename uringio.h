@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include "blockio.h"
+#include "plugin.h"
+
+// Асинхронная обработка файла через io_uring: до queueDepth порций одновременно
+// читаются и записываются, а завершённые чтения тут же преобразуются. Буферы берутся
+// из постоянного пула и регистрируются в ядре. Где io_uring недоступен, те же порции
+// обрабатывают queueDepth потоков с pread/pwrite
+void UringEncryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher, unsigned queueDepth);
+
+// Расшифрование с распознаванием контейнера; результат совпадает со StreamDecryptFile
+void UringDecryptFile(const std::string& inPath, const std::string& outPath, const BlockCipher& cipher, unsigned queueDepth);
+
+// Статистика последней операции UringEncryptFile/UringDecryptFile в этом потоке
+AsyncIoStats GetAsyncIoStats();
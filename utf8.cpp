@@ -0,0 +1,431 @@
+#include "utf8.h"
+#include "cpudispatch.h"
+#include "trace.h"
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static void ThrowInvalid(size_t position) {
+    throw invalid_argument("Некорректная последовательность UTF-8 в позиции " + to_string(position));
+}
+
+// Длина символа с проверкой: без обрезанных, избыточно длинных последовательностей,
+// суррогатов и значений больше U+10FFFF
+static size_t DecodeLength(const uint8_t* text, size_t length, size_t i) {
+    uint8_t c = text[i];
+    size_t charLen;
+    uint8_t low = 0x80, high = 0xBF;
+
+    if (c < 0x80) {
+        return 1;
+    } else if (c < 0xC2) {
+        ThrowInvalid(i);
+    } else if (c < 0xE0) {
+        charLen = 2;
+    } else if (c < 0xF0) {
+        charLen = 3;
+        if (c == 0xE0) {
+            low = 0xA0;
+        } else if (c == 0xED) {
+            high = 0x9F;
+        }
+    } else if (c < 0xF5) {
+        charLen = 4;
+        if (c == 0xF0) {
+            low = 0x90;
+        } else if (c == 0xF4) {
+            high = 0x8F;
+        }
+    } else {
+        ThrowInvalid(i);
+    }
+
+    if (length - i < charLen) {
+        ThrowInvalid(i);
+    }
+    if (text[i + 1] < low || text[i + 1] > high) {
+        ThrowInvalid(i);
+    }
+    for (size_t k = 2; k < charLen; ++k) {
+        if ((text[i + k] & 0xC0) != 0x80) {
+            ThrowInvalid(i);
+        }
+    }
+    return charLen;
+}
+
+static size_t IndexScalar(const uint8_t* text, size_t length, uint32_t* starts) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; i += DecodeLength(text, length, i)) {
+        starts[count++] = static_cast<uint32_t>(i);
+    }
+    return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Проверка по таблицам (Keiser, Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"):
+// каждая пара соседних байт классифицируется тремя выборками по полубайтам, а длина
+// последовательностей проверяется по байтам, стоящим на 2 и 3 позиции раньше
+static const uint8_t TOO_SHORT = 1 << 0;
+static const uint8_t TOO_LONG = 1 << 1;
+static const uint8_t OVERLONG_3 = 1 << 2;
+static const uint8_t TOO_LARGE = 1 << 3;
+static const uint8_t SURROGATE = 1 << 4;
+static const uint8_t OVERLONG_2 = 1 << 5;
+static const uint8_t TOO_LARGE_1000 = 1 << 6;
+static const uint8_t OVERLONG_4 = 1 << 6;
+static const uint8_t TWO_CONTS = 1 << 7;
+static const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+alignas(16) static const uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+alignas(16) static const uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+alignas(16) static const uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// Начала символов - все байты, кроме 10xxxxxx; запись позиций по маске
+static inline uint32_t* EmitStarts(uint32_t* out, uint32_t mask, size_t base) {
+    while (mask != 0) {
+        *out++ = static_cast<uint32_t>(base + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    return out;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i CheckUTF8AVX2(__m256i input, __m256i previous) {
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    const __m256i table1High = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)));
+    const __m256i table1Low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)));
+    const __m256i table2High = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)));
+
+    __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+    __m256i byte1High = _mm256_shuffle_epi8(table1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+    __m256i byte1Low = _mm256_shuffle_epi8(table1Low, _mm256_and_si256(prev1, lowNibble));
+    __m256i byte2High = _mm256_shuffle_epi8(table2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23, special);
+}
+
+__attribute__((target("avx2")))
+static bool IndexAVX2(const uint8_t* text, size_t length, uint32_t* starts, size_t& count) {
+    const __m256i offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i highBit = _mm256_set1_epi8(static_cast<char>(0x80));
+    __m256i previous = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    uint32_t* out = starts;
+
+    // Последний неполный кусок дополняется нулями; нули - ASCII, поэтому обрезанная
+    // в конце последовательность тоже обнаруживается
+    alignas(32) uint8_t tail[32];
+    for (size_t i = 0; i <= length; i += 32) {
+        __m256i input;
+        size_t available = length - i;
+        if (available >= 32) {
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        } else {
+            for (size_t k = 0; k < 32; ++k) {
+                tail[k] = k < available ? text[i + k] : 0;
+            }
+            input = _mm256_load_si256(reinterpret_cast<const __m256i*>(tail));
+        }
+
+        uint32_t nonAscii = static_cast<uint32_t>(_mm256_movemask_epi8(input));
+        if (nonAscii == 0 && _mm256_testz_si256(previous, highBit)) {
+            // Только ASCII: каждый байт - начало символа
+            size_t n = available >= 32 ? 32 : available;
+            __m256i base = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), offsets);
+            for (size_t k = 0; k + 8 <= n; k += 8) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), _mm256_add_epi32(base, _mm256_set1_epi32(static_cast<int>(k))));
+            }
+            for (size_t k = n - n % 8; k < n; ++k) {
+                out[k] = static_cast<uint32_t>(i + k);
+            }
+            out += n;
+        } else {
+            error = _mm256_or_si256(error, CheckUTF8AVX2(input, previous));
+            // 10xxxxxx: после xor с 0x80 старшие два бита нулевые, то есть байт меньше 0x40
+            __m256i flipped = _mm256_xor_si256(input, highBit);
+            __m256i isContinuation = _mm256_cmpeq_epi8(_mm256_min_epu8(flipped, _mm256_set1_epi8(0x3F)), flipped);
+            uint32_t startMask = ~static_cast<uint32_t>(_mm256_movemask_epi8(isContinuation));
+            if (available < 32) {
+                startMask &= (1u << available) - 1;
+            }
+            out = EmitStarts(out, startMask, i);
+        }
+        previous = input;
+    }
+
+    count = static_cast<size_t>(out - starts);
+    return _mm256_testz_si256(error, error);
+}
+
+__attribute__((target("ssse3,sse4.1")))
+static inline __m128i CheckUTF8SSE(__m128i input, __m128i previous) {
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    const __m128i table1High = _mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH));
+    const __m128i table1Low = _mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW));
+    const __m128i table2High = _mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH));
+
+    __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+
+    __m128i byte1High = _mm_shuffle_epi8(table1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibble));
+    __m128i byte1Low = _mm_shuffle_epi8(table1Low, _mm_and_si128(prev1, lowNibble));
+    __m128i byte2High = _mm_shuffle_epi8(table2High, _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must23, special);
+}
+
+__attribute__((target("ssse3,sse4.1")))
+static bool IndexSSE(const uint8_t* text, size_t length, uint32_t* starts, size_t& count) {
+    const __m128i offsets = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i highBit = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i previous = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+    uint32_t* out = starts;
+
+    alignas(16) uint8_t tail[16];
+    for (size_t i = 0; i <= length; i += 16) {
+        __m128i input;
+        size_t available = length - i;
+        if (available >= 16) {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        } else {
+            for (size_t k = 0; k < 16; ++k) {
+                tail[k] = k < available ? text[i + k] : 0;
+            }
+            input = _mm_load_si128(reinterpret_cast<const __m128i*>(tail));
+        }
+
+        uint32_t nonAscii = static_cast<uint32_t>(_mm_movemask_epi8(input));
+        if (nonAscii == 0 && _mm_testz_si128(previous, highBit)) {
+            size_t n = available >= 16 ? 16 : available;
+            __m128i base = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(i)), offsets);
+            for (size_t k = 0; k + 4 <= n; k += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), _mm_add_epi32(base, _mm_set1_epi32(static_cast<int>(k))));
+            }
+            for (size_t k = n - n % 4; k < n; ++k) {
+                out[k] = static_cast<uint32_t>(i + k);
+            }
+            out += n;
+        } else {
+            error = _mm_or_si128(error, CheckUTF8SSE(input, previous));
+            // 10xxxxxx: после xor с 0x80 старшие два бита нулевые, то есть байт меньше 0x40
+            __m128i flipped = _mm_xor_si128(input, highBit);
+            __m128i isContinuation = _mm_cmpeq_epi8(_mm_min_epu8(flipped, _mm_set1_epi8(0x3F)), flipped);
+            uint32_t startMask = ~static_cast<uint32_t>(_mm_movemask_epi8(isContinuation)) & 0xFFFF;
+            if (available < 16) {
+                startMask &= (1u << available) - 1;
+            }
+            out = EmitStarts(out, startMask, i);
+        }
+        previous = input;
+    }
+
+    count = static_cast<size_t>(out - starts);
+    return _mm_testz_si128(error, error);
+}
+
+__attribute__((target("avx2")))
+static bool IsAsciiAVX2(const uint8_t* text, size_t length) {
+    const __m256i highBit = _mm256_set1_epi8(static_cast<char>(0x80));
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, highBit)) {
+            return false;
+        }
+    }
+    for (; i + 32 <= length; i += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i))) != 0) {
+            return false;
+        }
+    }
+    for (; i < length; ++i) {
+        if (text[i] & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+__attribute__((target("sse2")))
+static bool IsAsciiSSE(const uint8_t* text, size_t length) {
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            return false;
+        }
+    }
+    for (; i + 16 <= length; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i))) != 0) {
+            return false;
+        }
+    }
+    for (; i < length; ++i) {
+        if (text[i] & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Хвост короче регистра читается маскированной загрузкой
+__attribute__((target("avx512f,avx512bw")))
+static bool IsAsciiAVX512(const uint8_t* text, size_t length) {
+    size_t i = 0;
+    for (; i + 256 <= length; i += 256) {
+        __m512i a = _mm512_loadu_si512(text + i);
+        __m512i b = _mm512_loadu_si512(text + i + 64);
+        __m512i c = _mm512_loadu_si512(text + i + 128);
+        __m512i d = _mm512_loadu_si512(text + i + 192);
+        if (_mm512_movepi8_mask(_mm512_or_si512(_mm512_or_si512(a, b), _mm512_or_si512(c, d))) != 0) {
+            return false;
+        }
+    }
+    for (; i + 64 <= length; i += 64) {
+        if (_mm512_movepi8_mask(_mm512_loadu_si512(text + i)) != 0) {
+            return false;
+        }
+    }
+    if (i < length) {
+        __mmask64 tail = ~0ULL >> (64 - (length - i));
+        if (_mm512_movepi8_mask(_mm512_maskz_loadu_epi8(tail, text + i)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+
+// Проверка по 8 байт за раз
+static bool IsAsciiScalar(const uint8_t* text, size_t length) {
+    uint64_t any = 0;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        any |= word;
+    }
+    for (; i < length; ++i) {
+        any |= text[i];
+    }
+    return (any & 0x8080808080808080ULL) == 0;
+}
+
+using IsAsciiKernel = bool (*)(const uint8_t* text, size_t length);
+using IndexKernel = bool (*)(const uint8_t* text, size_t length, uint32_t* starts, size_t& count);
+
+// Варианты ядер для уровня GetIsaLevel(); indexCodePoints == nullptr - только скалярный разбор
+struct Utf8Kernels {
+    IsAsciiKernel isAscii;
+    IndexKernel indexCodePoints;
+};
+
+static Utf8Kernels SelectKernels() {
+    switch (GetIsaLevel()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case IsaLevel::AVX512VBMI:
+        case IsaLevel::AVX512:
+            return {IsAsciiAVX512, IndexAVX2};
+        case IsaLevel::AVX2:
+            return {IsAsciiAVX2, IndexAVX2};
+        case IsaLevel::SSE42:
+            return {IsAsciiSSE, IndexSSE};
+#endif
+        default:
+            return {IsAsciiScalar, nullptr};
+    }
+}
+
+// Выбираются при загрузке библиотеки, до первого вызова
+static const Utf8Kernels kernels = SelectKernels();
+
+bool IsAscii(const char* text, size_t length) {
+    return kernels.isAscii(reinterpret_cast<const uint8_t*>(text), length);
+}
+
+void IndexCodePoints(const char* text, size_t length, vector<uint32_t>& starts) {
+    if (length > UINT32_MAX) {
+        throw length_error("Текст длиннее 4 ГБ не поддерживается");
+    }
+
+    TraceSpan span("utf8_index", length);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text);
+    starts.resize(length + 1);
+    size_t count = 0;
+    bool valid = false;
+
+    if (kernels.indexCodePoints) {
+        valid = kernels.indexCodePoints(bytes, length, starts.data(), count);
+    }
+
+    // Скалярный разбор - и запасной путь, и поиск точной позиции ошибки
+    if (!valid) {
+        count = IndexScalar(bytes, length, starts.data());
+    }
+
+    starts[count] = static_cast<uint32_t>(length);
+    starts.resize(count + 1);
+}
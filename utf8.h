@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Позиции начала символов UTF-8 с завершающим элементом length:
+// символ i занимает байты [starts[i], starts[i + 1]). Некорректный UTF-8
+// (обрезанные и избыточно длинные последовательности, суррогаты) - invalid_argument
+void IndexCodePoints(const char* text, size_t length, std::vector<uint32_t>& starts);
+
+// Все байты текста - 7-битный ASCII (каждый символ занимает один байт)
+bool IsAscii(const char* text, size_t length);
@@ -0,0 +1,109 @@
+#include "vectorgather.h"
+#include "cpudispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+using VectorGatherKernel = size_t (*)(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Маска перестановки для регистра шириной width байт: в него помещается width / blockSize целых блоков
+static void FillShuffleMask(uint8_t* mask, size_t width, const uint8_t* gather, size_t blockSize) {
+    size_t blocksPerVector = width / blockSize;
+    for (size_t i = 0; i < width; ++i) {
+        mask[i] = 0;
+    }
+    for (size_t b = 0; b < blocksPerVector; ++b) {
+        for (size_t j = 0; j < blockSize; ++j) {
+            mask[b * blockSize + j] = static_cast<uint8_t>(b * blockSize + gather[j]);
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static size_t GatherBlocksSSSE3(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize) {
+    alignas(16) uint8_t maskBytes[16];
+    FillShuffleMask(maskBytes, 16, gather, blockSize);
+    const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(maskBytes));
+    const size_t step = (16 / blockSize) * blockSize;
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += step) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+// vpshufb работает внутри 128-битных половин, поэтому вторая половина загружается со смещением step
+__attribute__((target("avx2")))
+static size_t GatherBlocksAVX2(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize) {
+    alignas(16) uint8_t maskBytes[16];
+    FillShuffleMask(maskBytes, 16, gather, blockSize);
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(maskBytes)));
+    const size_t step = (16 / blockSize) * blockSize;
+
+    size_t i = 0;
+    for (; i + step + 16 <= length; i += 2 * step) {
+        __m256i v = _mm256_loadu2_m128i(reinterpret_cast<const __m128i*>(src + i + step), reinterpret_cast<const __m128i*>(src + i));
+        __m256i r = _mm256_shuffle_epi8(v, mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(r));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + step), _mm256_extracti128_si256(r, 1));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t GatherBlocksVBMI(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize) {
+    alignas(64) uint8_t maskBytes[64];
+    FillShuffleMask(maskBytes, 64, gather, blockSize);
+    const __m512i mask = _mm512_load_si512(maskBytes);
+    const size_t step = (64 / blockSize) * blockSize;
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += step) {
+        __m512i v = _mm512_loadu_si512(src + i);
+        // Форма с нулевой маской: у _mm512_permutexvar_epi8 в GCC 12 неопределённый
+        // операнд-заполнитель, и -Wall предупреждает о неинициализированном значении
+        _mm512_storeu_si512(dst + i, _mm512_maskz_permutexvar_epi8(~0ULL, mask, v));
+    }
+    return i;
+}
+
+#endif
+
+// Ядро выбранного варианта и наибольший размер блока, который оно обрабатывает
+struct VectorGatherVariant {
+    VectorGatherKernel kernel;
+    size_t maxBlockSize;
+};
+
+static VectorGatherVariant SelectVariant() {
+    switch (GetIsaLevel()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case IsaLevel::AVX512VBMI:
+            return {GatherBlocksVBMI, 64};
+        case IsaLevel::AVX512:
+        case IsaLevel::AVX2:
+            return {GatherBlocksAVX2, 16};
+        case IsaLevel::SSE42:
+            return {GatherBlocksSSSE3, 16};
+#endif
+        default:
+            return {nullptr, 0};
+    }
+}
+
+// Выбирается при загрузке библиотеки, до первого вызова
+static const VectorGatherVariant variant = SelectVariant();
+
+size_t GatherBlocksVector(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize) {
+    if (blockSize == 0 || blockSize > variant.maxBlockSize) {
+        return 0;
+    }
+    return variant.kernel(src, dst, length, gather, blockSize);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Наибольший размер блока, для которого бывает векторное ядро выборки
+const size_t MAX_VECTOR_GATHER_BLOCK = 64;
+
+// Векторная выборка целых блоков: dst[block + k] = src[block + gather[k]]. Вариант ядра
+// (SSSE3, AVX2, AVX-512 VBMI) выбирается один раз при загрузке библиотеки
+// по GetIsaLevel(). Возвращает количество обработанных байт (кратно blockSize); остаток
+// и блоки, для которых у выбранного варианта нет ядра, обрабатывает вызывающий
+size_t GatherBlocksVector(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* gather, size_t blockSize);